@@ -139,7 +139,8 @@ alOverlaySignal(AlertOverlay::Type::signalTracking)
         // First-Order directivity visualizer (The "O"verhead view)
         addAndMakeVisible (&polarPatternVisualizers[i]);
         polarPatternVisualizers[i].setActive(true);
-        polarPatternVisualizers[i].setDirWeight (slDir[i].getValue());
+        shownDirFactors[i] = slDir[i].getValue();
+        polarPatternVisualizers[i].setDirWeight (shownDirFactors[i]);
         polarPatternVisualizers[i].setMuteSoloButtons (&msbSolo[i], &msbMute[i]);
         polarPatternVisualizers[i].setColour (eqColours[i]);
         
@@ -157,6 +158,7 @@ alOverlaySignal(AlertOverlay::Type::signalTracking)
     }
     
     directivityEqualiser.initValueBox();
+    directivityEqualiser.onBandLimitsMoved = [this] { resized(); }; // the band controls follow the band limits
     
     addAndMakeVisible (&tbLoadFile);
     tbLoadFile.setButtonText ("load preset");
@@ -166,6 +168,10 @@ alOverlaySignal(AlertOverlay::Type::signalTracking)
     tbSaveFile.setButtonText ("save preset");
     tbSaveFile.addListener (this);
     
+    addAndMakeVisible (&tbBrowsePresets);
+    tbBrowsePresets.setButtonText ("browse presets");
+    tbBrowsePresets.addListener (this);
+    
     addAndMakeVisible (&tbRecordDisturber);
     tbRecordDisturber.setButtonText ("terminate spill");
     tbRecordDisturber.addListener (this);
@@ -174,11 +180,49 @@ alOverlaySignal(AlertOverlay::Type::signalTracking)
     tbRecordSignal.setButtonText ("maximize target");
     tbRecordSignal.addListener (this);
     
+    addAndMakeVisible (&cbTrackingWindow);
+    cbTrackingWindow.setEditableText (false);
+    const String windowSeconds (roundToInt (PolarDesignerAudioProcessor::TRACKING_WINDOW_SECONDS));
+    // item ids are the BandEnergyTracker modes + 1
+    cbTrackingWindow.addItemList (juce::StringArray ({"whole recording", "first " + windowSeconds + " seconds",
+        "last " + windowSeconds + " seconds"}), 1);
+    cbTrackingWindow.setJustificationType (Justification::centred);
+    cbTrackingWindow.setTooltip ("part of the recording the polar patterns are optimised for, fitting the crossovers always uses all of it");
+    cbTrackingWindow.setSelectedId (static_cast<int> (processor.getTrackingWindow()) + 1, dontSendNotification);
+    cbTrackingWindow.addListener (this);
+    
+    addAndMakeVisible (&tbKeepRecordings);
+    tbKeepRecordings.setButtonText ("keep recordings");
+    tbKeepRecordings.setTooltip ("store the recorded signals, to apply them again after changing the bands");
+    tbKeepRecordings.setToggleState (processor.getKeepRecordings(), dontSendNotification);
+    tbKeepRecordings.addListener (this);
+    
+    addAndMakeVisible (&tbReapplyRecordings);
+    tbReapplyRecordings.setButtonText ("re-apply recordings");
+    tbReapplyRecordings.setEnabled (processor.hasRecordings());
+    tbReapplyRecordings.addListener (this);
+    
     addAndMakeVisible (&tbAllowBackwardsPattern);
     tbAllowBackwardsPatternAtt = std::unique_ptr<ButtonAttachment>(new ButtonAttachment (valueTreeState, "allowBackwardsPattern", tbAllowBackwardsPattern));
     tbAllowBackwardsPattern.setButtonText ("allow reverse patterns");
     tbAllowBackwardsPattern.addListener (this);
     
+    addAndMakeVisible (&tbAdaptiveMode);
+    tbAdaptiveModeAtt = std::unique_ptr<ButtonAttachment>(new ButtonAttachment (valueTreeState, "adaptiveMode", tbAdaptiveMode));
+    tbAdaptiveMode.setButtonText ("adaptive spill terminator");
+    tbAdaptiveMode.setTooltip ("continuously steer the pattern of every band to minimize spill");
+    tbAdaptiveMode.addListener (this);
+    
+    addAndMakeVisible (&tbSpectralFit);
+    tbSpectralFitAtt = std::unique_ptr<ButtonAttachment>(new ButtonAttachment (valueTreeState, "spectralFit", tbSpectralFit));
+    tbSpectralFit.setButtonText ("fit crossover frequencies");
+    tbSpectralFit.setTooltip ("after recording, also move the crossover frequencies to where the optimal pattern changes");
+    
+    addAndMakeVisible (&tbSpectralEngine);
+    tbSpectralEngineAtt = std::unique_ptr<ButtonAttachment>(new ButtonAttachment (valueTreeState, "spectralEngine", tbSpectralEngine));
+    tbSpectralEngine.setButtonText ("high resolution engine");
+    tbSpectralEngine.setTooltip ("blend the patterns smoothly over frequency instead of using the filter bank (higher latency)");
+    
     addAndMakeVisible (&tbEq[0]);
     tbEq[0].addListener (this);
     tbEq[0].setButtonText ("off");
@@ -295,9 +339,12 @@ alOverlaySignal(AlertOverlay::Type::signalTracking)
         }
     }
     
-    
-    
-    
+    // named sync group: any number of linked instances, replaces the sync channel while set
+    addAndMakeVisible (&teSyncGroup);
+    teSyncGroup.setTextToShowWhenEmpty ("sync group name", Colours::grey);
+    teSyncGroup.setText (processor.getSyncGroupName(), false);
+    teSyncGroup.onReturnKey = [this] { processor.setSyncGroupName (teSyncGroup.getText()); };
+    teSyncGroup.onFocusLost = [this] { processor.setSyncGroupName (teSyncGroup.getText()); };
     
     addAndMakeVisible (&slProximity);
     slProximityAtt = std::unique_ptr<ReverseSlider::SliderAttachment>(new ReverseSlider::SliderAttachment (valueTreeState, "proximity", slProximity));
@@ -444,6 +491,7 @@ void PolarDesignerAudioProcessorEditor::resized()
     sideComponent.items.add(juce::FlexItem(grpPreset).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem(tbLoadFile).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem(tbSaveFile).withFlex(sideComponentItemFlex));
+    sideComponent.items.add(juce::FlexItem(tbBrowsePresets).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem().withFlex(marginFlex));
     sideComponent.items.add(juce::FlexItem(grpEq).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem(tbEq[0]).withFlex(sideComponentItemFlex));
@@ -455,11 +503,18 @@ void PolarDesignerAudioProcessorEditor::resized()
     sideComponent.items.add(juce::FlexItem().withFlex(marginFlex));
     sideComponent.items.add(juce::FlexItem(grpDstC).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem(tbAllowBackwardsPattern).withFlex(sideComponentItemFlex));
+    sideComponent.items.add(juce::FlexItem(tbAdaptiveMode).withFlex(sideComponentItemFlex));
+    sideComponent.items.add(juce::FlexItem(tbSpectralFit).withFlex(sideComponentItemFlex));
+    sideComponent.items.add(juce::FlexItem(tbSpectralEngine).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem(tbRecordDisturber).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem(tbRecordSignal).withFlex(sideComponentItemFlex));
+    sideComponent.items.add(juce::FlexItem(cbTrackingWindow).withFlex(sideComponentItemFlex));
+    sideComponent.items.add(juce::FlexItem(tbKeepRecordings).withFlex(sideComponentItemFlex));
+    sideComponent.items.add(juce::FlexItem(tbReapplyRecordings).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem().withFlex(marginFlex));
     sideComponent.items.add(juce::FlexItem(grpSync).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem(cbSyncChannel).withFlex(sideComponentItemFlex));
+    sideComponent.items.add(juce::FlexItem(teSyncGroup).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem().withFlex(marginFlex));
 
     // Margins are fixed value because DirectivityEQ component has fixed margins
@@ -663,6 +718,10 @@ void PolarDesignerAudioProcessorEditor::buttonClicked (Button* button)
     {
         saveFile();
     }
+    else if (button == &tbBrowsePresets)
+    {
+        showPresetBrowser();
+    }
     else if (button == &tbEq[0])
     {
         processor.setEqState(0);
@@ -677,7 +736,8 @@ void PolarDesignerAudioProcessorEditor::buttonClicked (Button* button)
     }
     else if (button == &tbRecordDisturber)
     {
-        processor.startTracking(true);
+        processor.startTracking(true, processor.getTrackingWindow(), PolarDesignerAudioProcessor::TRACKING_WINDOW_SECONDS);
+        updateTrackingStatus();
         alOverlayDisturber.enableRatioButton(processor.getSignalRecorded());
         alOverlayDisturber.setVisible(true);
         disableMainArea();
@@ -685,7 +745,8 @@ void PolarDesignerAudioProcessorEditor::buttonClicked (Button* button)
     }
     else if (button == &tbRecordSignal)
     {
-        processor.startTracking(false);
+        processor.startTracking(false, processor.getTrackingWindow(), PolarDesignerAudioProcessor::TRACKING_WINDOW_SECONDS);
+        updateTrackingStatus();
         alOverlaySignal.enableRatioButton(processor.getDisturberRecorded());
         alOverlaySignal.setVisible(true);
         disableMainArea();
@@ -695,6 +756,21 @@ void PolarDesignerAudioProcessorEditor::buttonClicked (Button* button)
     {
         return;
     }
+    else if (button == &tbKeepRecordings)
+    {
+        processor.setKeepRecordings(button->getToggleState());
+        updateRecordingButtons();
+    }
+    else if (button == &tbReapplyRecordings)
+    {
+        processor.reanalyseRecordings();
+        updateRecordingButtons();
+    }
+    else if (button == &tbAdaptiveMode)
+    {
+        // recording a pattern makes no sense while the patterns adapt by themselves
+        updateRecordingButtons();
+    }
     else if (button == &tbZeroDelay)
     {
         bool isToggled = button->getToggleState();
@@ -722,12 +798,22 @@ void PolarDesignerAudioProcessorEditor::buttonClicked (Button* button)
     }
     else // muteSoloButton!
     {
-        directivityEqualiser.setSoloActive(getSoloActive());
-        directivityEqualiser.repaint();
-        for (auto& vis : polarPatternVisualizers)
+        // a mute only changes its own band, solo changes all of them
+        const bool soloActive = getSoloActive();
+        int dirtyBands = PolarDesignerAudioProcessor::ALL_BANDS;
+        for (int i = 0; i < 5; ++i)
         {
-            vis.setSoloActive(getSoloActive());
-            vis.repaint();
+            if (button == &msbMute[i] && soloActive == directivityEqualiser.isSoloActive())
+                dirtyBands = 1 << i;
+        }
+        
+        directivityEqualiser.setSoloActive(soloActive);
+        directivityEqualiser.repaintBands(dirtyBands);
+        for (int i = 0; i < 5; ++i)
+        {
+            polarPatternVisualizers[i].setSoloActive(soloActive);
+            if ((dirtyBands & (1 << i)) != 0)
+                polarPatternVisualizers[i].repaint();
         }
     }
 }
@@ -799,6 +885,10 @@ void PolarDesignerAudioProcessorEditor::comboBoxChanged (ComboBox* cb)
         }
         resized();
     }
+    else if (cb == &cbTrackingWindow)
+    {
+        processor.setTrackingWindow(static_cast<BandEnergyTracker::Mode>(cb->getSelectedId() - 1));
+    }
 }
 
 void PolarDesignerAudioProcessorEditor::sliderValueChanged(Slider* slider)
@@ -814,11 +904,20 @@ void PolarDesignerAudioProcessorEditor::sliderValueChanged(Slider* slider)
         }
         else
         {
-            // dirSlider
+            // dirSlider and gain slider: only their band is repainted
             for (int i = 0; i < 5; i++)
             {
-                if (slider == &slDir[i])
-                    polarPatternVisualizers[i].setDirWeight(slider->getValue());
+                if (slider == &slDir[i] && !processor.adaptiveModeActive())
+                {
+                    shownDirFactors[i] = slider->getValue();
+                    polarPatternVisualizers[i].setDirWeight(shownDirFactors[i]);
+                }
+                
+                if (slider == &slDir[i] || slider == &slBandGain[i])
+                {
+                    directivityEqualiser.repaintBands(1 << i);
+                    return;
+                }
             }
         }
     directivityEqualiser.repaint();
@@ -831,24 +930,53 @@ void PolarDesignerAudioProcessorEditor::loadFile()
                            "*.json");
     if (myChooser.browseForFileToOpen())
     {
-        loadingFile = true;
         File presetFile (myChooser.getResult());
         processor.setLastDir(presetFile.getParentDirectory());
-        Result result = processor.loadPreset (presetFile);
-        if (!result.wasOk()) {
-            errorMessage = result.getErrorMessage();
-            alOverlayError.setTitle("preset load error!");
+        loadPresetFile(presetFile);
+    }
+}
+
+void PolarDesignerAudioProcessorEditor::loadPresetFile(const File& presetFile)
+{
+    loadingFile = true;
+    StringArray warnings;
+    Result result = processor.loadPreset (presetFile, &warnings);
+    if (!result.wasOk()) {
+        errorMessage = result.getErrorMessage();
+        alOverlayError.setTitle("preset load error!");
+        alOverlayError.setMessage(errorMessage);
+        alOverlayError.setVisible(true);
+        disableMainArea();
+        setSideAreaEnabled(false);
+    }
+    else
+    {
+        setEqMode();
+        if (!warnings.isEmpty())
+        {
+            // the preset is applied, but not exactly as stored
+            errorMessage = warnings.joinIntoString("\n");
+            alOverlayError.setTitle("preset loaded with changes!");
             alOverlayError.setMessage(errorMessage);
             alOverlayError.setVisible(true);
             disableMainArea();
             setSideAreaEnabled(false);
         }
-        else
-        {
-            setEqMode();
-        }
-        loadingFile = false;
     }
+    loadingFile = false;
+}
+
+// presets of the preset folder and its sub folders; loading one keeps the folder
+void PolarDesignerAudioProcessorEditor::showPresetBrowser()
+{
+    Component::SafePointer<PolarDesignerAudioProcessorEditor> safeThis (this);
+    auto browser = std::make_unique<PresetBrowser> (processor.getPresetLibrary(), Array<Colour> (eqColours, 5),
+                                                    [safeThis] (const File& presetFile)
+                                                    {
+                                                        if (safeThis != nullptr)
+                                                            safeThis->loadPresetFile(presetFile);
+                                                    });
+    CallOutBox::launchAsynchronously (std::move (browser), tbBrowsePresets.getBounds(), this);
 }
 
 void PolarDesignerAudioProcessorEditor::saveFile()
@@ -925,15 +1053,15 @@ void PolarDesignerAudioProcessorEditor::nActiveBandsChanged()
     
     directivityEqualiser.resetTooltipTexts();
     directivityEqualiser.repaint();
+    directivityEqualiser.updateBandLimits(true); // lays out the band controls of the new bands
     
 }
 
 void PolarDesignerAudioProcessorEditor::timerCallback()
 {
-    if (processor.repaintDEQ.get())
+    if (const int dirtyBands = processor.repaintDEQ.exchange(0))
     {
-        processor.repaintDEQ = false;
-        directivityEqualiser.repaint();
+        directivityEqualiser.repaintBands(dirtyBands);
     }
     if (processor.didNRActiveBandsChange.get())
     {
@@ -950,6 +1078,47 @@ void PolarDesignerAudioProcessorEditor::timerCallback()
         processor.ffDfEqChanged = false;
         setEqMode();
     }
+    if (processor.isAnalysing() != analysisRunning)
+        updateRecordingButtons();
+    if (alOverlayDisturber.isVisible() || alOverlaySignal.isVisible())
+        updateTrackingStatus();
+    else if (!alOverlayError.isVisible())
+        showRecordingError();
+    updateShownPatterns();
+}
+
+void PolarDesignerAudioProcessorEditor::showRecordingError()
+{
+    const String recordingError = processor.takeRecordingError();
+    if (recordingError.isEmpty())
+        return;
+    
+    errorMessage = recordingError;
+    alOverlayError.setTitle("recording error!");
+    alOverlayError.setMessage(errorMessage);
+    alOverlayError.setVisible(true);
+    disableMainArea();
+    setSideAreaEnabled(false);
+}
+
+// the adaptive mode changes the patterns without moving the sliders, they are shown until it is switched off
+void PolarDesignerAudioProcessorEditor::updateShownPatterns()
+{
+    const bool adaptive = processor.adaptiveModeActive();
+    int changedBands = 0;
+    for (int i = 0; i < 5; i++)
+    {
+        const float dirFactor = adaptive ? processor.getAdaptiveAlpha(i) : static_cast<float>(slDir[i].getValue());
+        if (dirFactor != shownDirFactors[i])
+        {
+            shownDirFactors[i] = dirFactor;
+            polarPatternVisualizers[i].setDirWeight(dirFactor);
+            changedBands |= 1 << i;
+        }
+    }
+    
+    if (changedBands != 0)
+        directivityEqualiser.repaintBands(changedBands);
 }
 
 void PolarDesignerAudioProcessorEditor::zeroDelayModeChange()
@@ -991,6 +1160,7 @@ void PolarDesignerAudioProcessorEditor::zeroDelayModeChange()
     
     directivityEqualiser.resetTooltipTexts();
     directivityEqualiser.repaint();
+    directivityEqualiser.updateBandLimits(true);
 }
 
 void PolarDesignerAudioProcessorEditor::disableMainArea()
@@ -1016,6 +1186,7 @@ void PolarDesignerAudioProcessorEditor::onAlOverlayApplyPattern()
 {
     disableOverlay();
     processor.stopTracking(1);
+    updateRecordingButtons();
 }
 
 void PolarDesignerAudioProcessorEditor::onAlOverlayCancelRecord()
@@ -1028,6 +1199,7 @@ void PolarDesignerAudioProcessorEditor::onAlOverlayMaxSigToDist()
 {
     disableOverlay();
     processor.stopTracking(2);
+    updateRecordingButtons();
 }
 
 void PolarDesignerAudioProcessorEditor::setSideAreaEnabled(bool set)
@@ -1043,18 +1215,63 @@ void PolarDesignerAudioProcessorEditor::setSideAreaEnabled(bool set)
     tbSyncChannel[3].setEnabled(set);
     tbSyncChannel[4].setEnabled(set);
     tbSyncChannel[5].setEnabled(set);
+    teSyncGroup.setEnabled(set);
     
     //    cbSetNrBands.setEnabled(set);
     //    cbSyncChannel.setEnabled(set);
     tbLoadFile.setEnabled(set);
     tbSaveFile.setEnabled(set);
+    tbBrowsePresets.setEnabled(set);
     tbEq[0].setEnabled(set);
     tbEq[1].setEnabled(set);
     tbEq[2].setEnabled(set);
     tbAllowBackwardsPattern.setEnabled(set);
-    tbRecordDisturber.setEnabled(set);
-    tbRecordSignal.setEnabled(set);
+    tbAdaptiveMode.setEnabled(set);
+    tbSpectralFit.setEnabled(set);
+    tbSpectralEngine.setEnabled(set);
+    cbTrackingWindow.setEnabled(set);
+    tbKeepRecordings.setEnabled(set);
     slProximity.setEnabled(set);
+    
+    sideAreaEnabled = set;
+    updateRecordingButtons();
+}
+
+// no recording or re-analysis can start before the background analysis has applied its patterns
+void PolarDesignerAudioProcessorEditor::updateRecordingButtons()
+{
+    analysisRunning = processor.isAnalysing();
+    const bool enable = sideAreaEnabled && !analysisRunning;
+    
+    tbReapplyRecordings.setEnabled(enable && processor.hasRecordings());
+    tbRecordDisturber.setEnabled(enable && !processor.adaptiveModeActive());
+    tbRecordSignal.setEnabled(enable && !processor.adaptiveModeActive());
+}
+
+void PolarDesignerAudioProcessorEditor::updateTrackingStatus()
+{
+    const double seconds = processor.getTrackedSeconds();
+    const double windowSeconds = PolarDesignerAudioProcessor::TRACKING_WINDOW_SECONDS;
+    String status ("recorded: " + String (seconds, 1) + " s");
+    
+    switch (processor.getTrackingWindow())
+    {
+        case BandEnergyTracker::Mode::fixedLength:
+            if (processor.isTrackingWindowComplete())
+                status = "first " + String (roundToInt (windowSeconds)) + " s recorded, terminate to apply";
+            else
+                status << " of " << roundToInt (windowSeconds) << " s";
+            break;
+        case BandEnergyTracker::Mode::sliding:
+            if (seconds > windowSeconds)
+                status << ", using the last " << roundToInt (windowSeconds) << " s";
+            break;
+        case BandEnergyTracker::Mode::accumulate:
+            break;
+    }
+    
+    alOverlayDisturber.setStatus (status);
+    alOverlaySignal.setStatus (status);
 }
 
 void PolarDesignerAudioProcessorEditor::setEqMode()
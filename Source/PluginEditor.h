@@ -38,6 +38,7 @@
 #include "../resources/customComponents/DirectivityEQ.h"
 #include "../resources/customComponents/AlertOverlay.h"
 #include "../resources/customComponents/EndlessSlider.h"
+#include "../resources/customComponents/PresetBrowser.h"
 
 typedef AudioProcessorValueTreeState::SliderAttachment SliderAttachment;
 typedef AudioProcessorValueTreeState::ButtonAttachment ButtonAttachment;
@@ -90,6 +91,9 @@ private:
     
     bool loadingFile;
     bool recordingDisturber;
+    bool sideAreaEnabled = true;
+    bool analysisRunning = false;
+    float shownDirFactors[5] = {}; // patterns of the polar pattern visualizers
     
     Colour eqColours[5];
  
@@ -118,18 +122,19 @@ private:
     // Solo Buttons
     MuteSoloButton msbSolo[5], msbMute[5];
     // Text Buttons
-    TextButton tbLoadFile, tbSaveFile, tbRecordDisturber, tbRecordSignal, tbZeroDelay, tbAbButton[2];
+    TextButton tbLoadFile, tbSaveFile, tbBrowsePresets, tbRecordDisturber, tbRecordSignal, tbReapplyRecordings, tbZeroDelay, tbAbButton[2];
     // ToggleButtons
-    ToggleButton tbEq[3], tbAllowBackwardsPattern;
+    ToggleButton tbEq[3], tbAllowBackwardsPattern, tbAdaptiveMode, tbSpectralFit, tbSpectralEngine, tbKeepRecordings;
     // Combox Boxes
-    ComboBox cbSetNrBands, cbSyncChannel;
+    ComboBox cbSetNrBands, cbSyncChannel, cbTrackingWindow;
+    TextEditor teSyncGroup;
     TextButton tbSetNrBands[5];
     TextButton tbSyncChannel[5];
             
     // Pointers for value tree state
     std::unique_ptr<ReverseSlider::SliderAttachment> slBandGainAtt[5], slCrossoverAtt[4], slProximityAtt;
     std::unique_ptr<SliderAttachment> slDirAtt[5];
-    std::unique_ptr<ButtonAttachment> msbSoloAtt[5], msbMuteAtt[5], tbAllowBackwardsPatternAtt, tbZeroDelayAtt;
+    std::unique_ptr<ButtonAttachment> msbSoloAtt[5], msbMuteAtt[5], tbAllowBackwardsPatternAtt, tbAdaptiveModeAtt, tbSpectralFitAtt, tbSpectralEngineAtt, tbZeroDelayAtt;
     std::unique_ptr<ComboBoxAttachment> cbSetNrBandsAtt, cbSyncChannelAtt;
     
     DirectivityEQ directivityEqualiser;
@@ -147,11 +152,17 @@ private:
     //==========================================================================
     void nActiveBandsChanged();
     void loadFile();
+    void loadPresetFile(const File& presetFile);
     void saveFile();
+    void showPresetBrowser();
     void timerCallback() override;
     bool getSoloActive();
     void disableMainArea();
     void setSideAreaEnabled(bool set);
+    void updateRecordingButtons();
+    void updateTrackingStatus();
+    void updateShownPatterns();
+    void showRecordingError();
     void disableOverlay();
     void zeroDelayModeChange();
     
@@ -38,22 +38,22 @@ nBands(5),
 vtsParams(*this, nullptr, "AAPolarDesigner",
           {
     std::make_unique<AudioParameterFloat> (ParameterID {"xOverF1", 1}, "Xover1", NormalisableRange<float>(0.0f, 1.0f, 0.0001f),
-                                           hzToZeroToOne(0, INIT_XOVER_FREQS_5B[0]), "",
+                                           BandConfigs::get(5).hzToZeroToOne(0, BandConfigs::get(5).initXoverFreqs[0]), "",
                                            AudioProcessorParameter::genericParameter,
                                            [&](float value, int maximumStringLength) {return String(std::roundf(hzFromZeroToOne(0, value))) + " Hz";},
                                            nullptr),
     std::make_unique<AudioParameterFloat> (ParameterID {"xOverF2", 1}, "Xover2", NormalisableRange<float>(0.0f, 1.0f, 0.0001f),
-                                           hzToZeroToOne(1, INIT_XOVER_FREQS_5B[1]), "",
+                                           BandConfigs::get(5).hzToZeroToOne(1, BandConfigs::get(5).initXoverFreqs[1]), "",
                                            AudioProcessorParameter::genericParameter,
                                            [&](float value, int maximumStringLength) {return String(std::roundf(hzFromZeroToOne(1, value))) + " Hz";},
                                            nullptr),
     std::make_unique<AudioParameterFloat> (ParameterID {"xOverF3", 1}, "Xover3", NormalisableRange<float>(0.0f, 1.0f, 0.0001f),
-                                           hzToZeroToOne(2, INIT_XOVER_FREQS_5B[2]), "",
+                                           BandConfigs::get(5).hzToZeroToOne(2, BandConfigs::get(5).initXoverFreqs[2]), "",
                                            AudioProcessorParameter::genericParameter,
                                            [&](float value, int maximumStringLength) {return String(std::roundf(hzFromZeroToOne(2, value))) + " Hz";},
                                            nullptr),
     std::make_unique<AudioParameterFloat> (ParameterID {"xOverF4", 1}, "Xover4", NormalisableRange<float>(0.0f, 1.0f, 0.0001f),
-                                           hzToZeroToOne(3, INIT_XOVER_FREQS_5B[3]), "",
+                                           BandConfigs::get(5).hzToZeroToOne(3, BandConfigs::get(5).initXoverFreqs[3]), "",
                                            AudioProcessorParameter::genericParameter,
                                            [&](float value, int maximumStringLength) {return String(std::roundf(hzFromZeroToOne(3, value))) + " Hz";},
                                            nullptr),
@@ -117,11 +117,18 @@ vtsParams(*this, nullptr, "AAPolarDesigner",
     std::make_unique<AudioParameterBool>  (ParameterID {"zeroDelayMode", 1}, "Zero Latency", false, "",
                                            [](bool value, int maximumStringLength) {return (value) ? "on" : "off";}, nullptr),
     std::make_unique<AudioParameterInt>   (ParameterID {"syncChannel", 1}, "Sync to Channel", 0, 4, 0, "",
-                                           [](int value, int maximumStringLength) {return value == 0 ? "none" : String(value);}, nullptr)
+                                           [](int value, int maximumStringLength) {return value == 0 ? "none" : String(value);}, nullptr),
+    std::make_unique<AudioParameterBool>  (ParameterID {"adaptiveMode", 1}, "Adaptive Directivity", false, "",
+                                           [](bool value, int maximumStringLength) {return (value) ? "on" : "off";}, nullptr),
+    std::make_unique<AudioParameterBool>  (ParameterID {"spectralFit", 1}, "Fit Crossovers", false, "",
+                                           [](bool value, int maximumStringLength) {return (value) ? "on" : "off";}, nullptr),
+    std::make_unique<AudioParameterBool>  (ParameterID {"spectralEngine", 1}, "High Resolution Engine", false, "",
+                                           [](bool value, int maximumStringLength) {return (value) ? "on" : "off";}, nullptr),
+    std::make_unique<AudioParameterFloat> (ParameterID {"abMorph", 1}, "A/B Morph", NormalisableRange<float>(0.0f, 1.0f, 0.001f),
+                                           0.0f, "", AudioProcessorParameter::genericParameter,
+                                           [](float value, int maximumStringLength) { return String(roundToInt(value * 100)) + " %"; }, nullptr)
 }),
-firLen(FILTER_BANK_IR_LENGTH_AT_NATIVE_SAMPLE_RATE),
-dfEqOmniBuffer(1, DF_EQ_LEN), dfEqEightBuffer(1, DF_EQ_LEN),
-ffEqOmniBuffer(1, FF_EQ_LEN), ffEqEightBuffer(1, FF_EQ_LEN), isBypassed(false),
+firLen(FILTER_BANK_IR_LENGTH_AT_NATIVE_SAMPLE_RATE), isBypassed(false),
 soloActive(false), loadingFile(false), readingSharedParams(false), trackingActive(false),
 trackingDisturber(false), disturberRecorded(false), signalRecorded(false), currentSampleRate(48000)
 {
@@ -158,6 +165,14 @@ trackingDisturber(false), disturberRecorded(false), signalRecorded(false), curre
     zeroDelayMode = vtsParams.getRawParameterValue("zeroDelayMode");
     vtsParams.addParameterListener("syncChannel", this);
     syncChannelPtr = vtsParams.getRawParameterValue("syncChannel");
+    vtsParams.addParameterListener("adaptiveMode", this);
+    adaptiveMode = vtsParams.getRawParameterValue("adaptiveMode");
+    vtsParams.addParameterListener("spectralFit", this); // only for the state cache
+    spectralFit = vtsParams.getRawParameterValue("spectralFit");
+    vtsParams.addParameterListener("spectralEngine", this);
+    spectralEngineMode = vtsParams.getRawParameterValue("spectralEngine");
+    vtsParams.addParameterListener("abMorph", this); // only for the state cache
+    abMorph = vtsParams.getRawParameterValue("abMorph");
     
     // properties file: saves user preset folder location
     PropertiesFile::Options options;
@@ -169,21 +184,28 @@ trackingDisturber(false), disturberRecorded(false), signalRecorded(false), curre
     properties = std::unique_ptr<PropertiesFile>(new PropertiesFile (options));
     lastDir = File(properties->getValue ("presetFolder"));
     
-    dfEqOmniBuffer.copyFrom(0, 0, DFEQ_COEFFS_OMNI, DF_EQ_LEN);
-    dfEqEightBuffer.copyFrom(0, 0, DFEQ_COEFFS_EIGHT, DF_EQ_LEN);
-    ffEqOmniBuffer.copyFrom(0, 0, FFEQ_COEFFS_OMNI, FF_EQ_LEN);
-    ffEqEightBuffer.copyFrom(0, 0, FFEQ_COEFFS_EIGHT, FF_EQ_LEN);
+    eqResponses = eqCache->getForSampleRate(currentSampleRate);
     
     updateLatency();
     delay.setDelayTime (std::ceilf(static_cast<float>(FILTER_BANK_IR_LENGTH_AT_NATIVE_SAMPLE_RATE) / 2 - 1) / FILTER_BANK_NATIVE_SAMPLE_RATE);
+    morphDelay.setDelayTime (std::ceilf(static_cast<float>(FILTER_BANK_IR_LENGTH_AT_NATIVE_SAMPLE_RATE) / 2 - 1) / FILTER_BANK_NATIVE_SAMPLE_RATE);
     
     oldProxDistance = proxDistance->load();
-    
-    startTimer(50);
 }
 
 PolarDesignerAudioProcessor::~PolarDesignerAudioProcessor()
 {
+    // a running analysis reads the recordings and the kernel store
+    backgroundTasks.cancelAll();
+    kernelTasks.cancelAll();
+    
+    if (SyncChannel<ParamsToSync>* group = syncGroup.load())
+        group->unsubscribe(this);
+    
+    // recordings are scratch files of this instance
+    captureRecorder.stop().deleteFile();
+    disturberCapture.deleteFile();
+    signalCapture.deleteFile();
 }
 
 //==============================================================================
@@ -271,39 +293,46 @@ void PolarDesignerAudioProcessor::prepareToPlay (double sampleRate, int samplesP
     // filter bank
     filterBankBuffer.setSize(N_CH_IN * 5, currentBlockSize);
     filterBankBuffer.clear();
-    firFilterBuffer.setSize(5, firLen);
-    firFilterBuffer.clear();
     omniEightBuffer.setSize(2, currentBlockSize);
     omniEightBuffer.clear();
     
-    computeAllFilterCoefficients();
-    initAllConvolvers();
+    // free field / diffuse field eq: these are not processed separately,
+    // initAllConvolvers() combines them with the filter bank kernels.
+    // Resampled responses are cached per sample rate and shared between instances.
+    if (eqResponses == nullptr || eqResponses->getSampleRate() != currentSampleRate)
+        eqResponses = eqCache->getForSampleRate(currentSampleRate);
+    
+    // convolvers only hold the input history, kernels are shared between instances
+    dsp::ProcessSpec convSpec {currentSampleRate, static_cast<uint32>(currentBlockSize), 1};
     for (auto &conv : convolvers)
     {
-        conv.reset();
+        conv.prepare(convSpec, getMaxKernelLength(), kernelStore.get());
     }
     
-    // diffuse field eq
-    dsp::ProcessSpec eqSpec {currentSampleRate, static_cast<uint32>(currentBlockSize), 1};
-    dfEqOmniConv.prepare (eqSpec); // must be called before loading an ir
-    dfEqOmniConv.loadImpulseResponse(std::move(dfEqOmniBuffer), EQ_SAMPLE_RATE, dsp::Convolution::Stereo::no, dsp::Convolution::Trim::no, dsp::Convolution::Normalise::no);
-    
-    dsp::ProcessSpec eqSpec2{ currentSampleRate, static_cast<uint32>(currentBlockSize), 1 };
-    dfEqEightConv.prepare (eqSpec2);
-    dfEqEightConv.loadImpulseResponse(std::move(dfEqEightBuffer), EQ_SAMPLE_RATE, dsp::Convolution::Stereo::no, dsp::Convolution::Trim::no, dsp::Convolution::Normalise::no);
-    
-    dsp::ProcessSpec eqSpec3{ currentSampleRate, static_cast<uint32>(currentBlockSize), 1 };
-    ffEqOmniConv.prepare (eqSpec3); // must be called before loading an ir
-    ffEqOmniConv.loadImpulseResponse(std::move(ffEqOmniBuffer), EQ_SAMPLE_RATE, dsp::Convolution::Stereo::no, dsp::Convolution::Trim::no, dsp::Convolution::Normalise::no);
-    
-    dsp::ProcessSpec eqSpec4{ currentSampleRate, static_cast<uint32>(currentBlockSize), 1 };
-    ffEqEightConv.prepare (eqSpec4);
-    ffEqEightConv.loadImpulseResponse(std::move(dfEqEightBuffer), EQ_SAMPLE_RATE, dsp::Convolution::Stereo::no, dsp::Convolution::Trim::no, dsp::Convolution::Normalise::no);
+    // A/B morph: second filter bank for the other layer, same size as the first one
+    for (auto &conv : morphConvolvers)
+    {
+        conv.prepare(convSpec, getMaxKernelLength(), kernelStore.get());
+    }
+    setOtherLayerKernelSet(otherLayerKernelSet); // kernels of another block size are replaced once rebuilt
+    morphOmniEightBuffer.setSize(2, currentBlockSize);
+    morphBankBuffer.setSize(2, currentBlockSize);
+    morphOutputBuffer.setSize(1, currentBlockSize);
+    morphDelay.prepare(delaySpec);
+    morphProxIIR.prepare({ currentSampleRate, static_cast<uint32> (currentBlockSize), 1 });
+    morphProxIIR.reset();
+    morphAmount.reset(currentSampleRate, MORPH_RAMP_SECONDS);
+    morphActive = false;
+    
+    // per bin pattern engine, its latency depends on the sample rate
+    spectralEngine.prepare(currentSampleRate, kernelStore.get());
+    spectralEngineWasActive = false;
+    updateLatency();
     
-    dfEqOmniConv.reset();
-    dfEqEightConv.reset();
-    ffEqOmniConv.reset();
-    ffEqEightConv.reset();
+    // preparing dropped the kernels: a set some instance already built is applied right away,
+    // otherwise it is built in the background and the delayed dry signal is played meanwhile
+    updateSpectralEngineEq();
+    requestKernelSet(true);
     
     for (int i = 0; i < 5; ++i)
     {
@@ -353,9 +382,32 @@ void PolarDesignerAudioProcessor::processBlock (AudioBuffer<float>& buffer, Midi
     
     int numSamples = buffer.getNumSamples();
     
+    // members of a sync group mix with the group's alphas and gains right away, their params follow
+    // on the message thread
+    updateBlockTimeline (numSamples);
+    SyncChannel<ParamsToSync>* group = syncGroup.load();
+    linkedParamsActive = group != nullptr && !adaptiveModeActive();
+    if (linkedParamsActive)
+    {
+        group->read (linkedParams);
+        linkedParamsActive = linkedParams.paramsValid;
+        
+        // ramps that were running before a transport jump are over, every member sees the same jump
+        if (timelineJumped)
+            for (int i = 0; i < 5; ++i)
+                finishedRampStart[i] = linkedParams.rampStart[i];
+    }
+    
     // create omni and eight signals
     createOmniAndEightSignals (buffer);
     
+    // A/B morph: the other layer gets the signals before the proximity filter of the active one
+    if (updateMorph())
+    {
+        morphOmniEightBuffer.copyFrom(0, 0, omniEightBuffer, 0, 0, numSamples);
+        morphOmniEightBuffer.copyFrom(1, 0, omniEightBuffer, 1, 0, numSamples);
+    }
+    
     // proximity compensation filter
     if (zeroDelayMode->load() < 0.5f && proxDistance->load() < -0.05) // reduce proximity effect only on figure-of-eight
     {
@@ -372,77 +424,52 @@ void PolarDesignerAudioProcessor::processBlock (AudioBuffer<float>& buffer, Midi
         proxCompIIR.process(contextProxOmni);
     }
     
-    if (doEq == 1 && zeroDelayMode->load() < 0.5f )
-    {
-        // free field equalization
-        float* writePointerOmni = omniEightBuffer.getWritePointer (0);
-        dsp::AudioBlock<float> ffEqOmniBlk(&writePointerOmni, 1, numSamples);
-        dsp::ProcessContextReplacing<float> ffEqOmniCtx (ffEqOmniBlk);
-        ffEqOmniConv.process(ffEqOmniCtx);
-        
-        float* writePointerEight = omniEightBuffer.getWritePointer (1);
-        dsp::AudioBlock<float> ffEqEightBlk(&writePointerEight, 1, numSamples);
-        dsp::ProcessContextReplacing<float> ffEqEightCtx (ffEqEightBlk);
-        ffEqEightConv.process(ffEqEightCtx);
-    }
-    else if (doEq == 2 && zeroDelayMode->load() < 0.5f )
-    {
-        // diffuse field equalization
-        float* writePointerOmni = omniEightBuffer.getWritePointer (0);
-        dsp::AudioBlock<float> dfEqOmniBlk(&writePointerOmni, 1, numSamples);
-        dsp::ProcessContextReplacing<float> dfEqOmniCtx (dfEqOmniBlk);
-        dfEqOmniConv.process(dfEqOmniCtx);
-        
-        float* writePointerEight = omniEightBuffer.getWritePointer (1);
-        dsp::AudioBlock<float> dfEqEightBlk(&writePointerEight, 1, numSamples);
-        dsp::ProcessContextReplacing<float> dfEqEightCtx (dfEqEightBlk);
-        dfEqEightConv.process(dfEqEightCtx);
-    }
-    
     int nActiveBands = nBands;
     
     // 1-band EQ
     if (zeroDelayMode->load() > 0.5f )
         nActiveBands = 1;
     
-    for (int i = 0; i < nActiveBands; ++i)
+    const bool useSpectralEngine = spectralEngineActive() && zeroDelayMode->load() < 0.5f;
+    if (useSpectralEngine && !spectralEngineWasActive)
+        spectralEngine.reset();
+    spectralEngineWasActive = useSpectralEngine;
+    
+    // 5-band EQ, free field / diffuse field eq is part of the band kernels
+    // (with only one band the kernels hold nothing but the eq)
+    const bool applyKernels = zeroDelayMode->load() < 0.5f && (nActiveBands > 1 || eqActive());
+    const bool bandsReady = !applyKernels || convolversReady;
+    if (!bandsReady && !useSpectralEngine)
     {
-        // copy input buffer for each band
-        filterBankBuffer.copyFrom (2*i, 0, omniEightBuffer, 0, 0, numSamples);
-        filterBankBuffer.copyFrom (2*i+1, 0, omniEightBuffer, 1, 0, numSamples);
+        createDelayedDryOutput (buffer);
+        return;
     }
     
-    // 5-band EQ
-    if (zeroDelayMode->load() < 0.5f && nActiveBands > 1)
+    // the spectral engine only needs the band signals for tracking and adaptation
+    if (bandsReady && (!useSpectralEngine || trackingActive || adaptiveModeActive()))
     {
-        if (!convolversReady)
+        // the number of bands is dispatched once per block, the band loops are specialised for it
+        switch (nActiveBands)
         {
-            return;
+            case 1: filterBands<1> (numSamples, applyKernels); break;
+            case 2: filterBands<2> (numSamples, applyKernels); break;
+            case 3: filterBands<3> (numSamples, applyKernels); break;
+            case 4: filterBands<4> (numSamples, applyKernels); break;
+            case 5: filterBands<5> (numSamples, applyKernels); break;
+            default: jassertfalse; break;
         }
         
-        // CODEREVIEW TODO: evaluate convolver use of FFT in JUCE::dsp to determine latency effects - Can we Replace with our own convolver code?
+        if (trackingActive)
+            trackSignalEnergy(numSamples, applyKernels);
         
-        for (int i = 0; i < nActiveBands; ++i)
-        {
-            // omni
-            float* writePointerOmni = filterBankBuffer.getWritePointer (2 * i);
-            dsp::AudioBlock<float> subBlk (&writePointerOmni, 1, numSamples);
-            dsp::ProcessContextReplacing<float> filterCtx (subBlk);
-            convolvers[2 * i].process (filterCtx); // mono processing
-            
-            // eight
-            float* writePointerEight = filterBankBuffer.getWritePointer (2 * i + 1);
-            dsp::AudioBlock<float> subBlk2 (&writePointerEight, 1, numSamples);
-            dsp::ProcessContextReplacing<float> filterCtx2 (subBlk2);
-            convolvers[2 * i + 1].process (filterCtx2); // mono processing
-        }
-        convolversReady = true;
+        if (adaptiveModeActive())
+            updateAdaptivePatterns (nActiveBands, numSamples);
     }
     
-    if (trackingActive)
-        trackSignalEnergy();
-    
-    createPolarPatterns (buffer);
+    if (useSpectralEngine)
+        createSpectralPatterns (buffer);
+    else
+        createPolarPatterns (buffer);
 }
 
 void PolarDesignerAudioProcessor::processBlockBypassed (AudioBuffer<float>& buffer, MidiBuffer& midiMessages)
@@ -473,47 +500,150 @@ AudioProcessorEditor* PolarDesignerAudioProcessor::createEditor()
 
 void PolarDesignerAudioProcessor::getStateInformation (MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
-    vtsParams.state.setProperty("ffDfEq", var(doEq), nullptr);
-    vtsParams.state.setProperty("oldProxDistance", var(oldProxDistance), nullptr);
+    // hosts ask for every undo step and autosave: unchanged states are handed out from the cache
+    const ScopedLock sl (stateCacheLock);
+    if (!stateDirty.exchange(false))
+    {
+        destData = cachedState;
+        return;
+    }
     
+    // binary layout, see StateCodec: the active layer is read from the parameters, the other one
+    // from its ValueTree, nothing is copied or converted to xml
     if (abLayerState == 1)
     {
-        layerA = vtsParams.copyState();
         doEqA = doEq;
         if (proxDistance->load() != 0) { oldProxDistanceA = proxDistance->load(); }
     }
     if (abLayerState == 0)
     {
-        layerB = vtsParams.copyState();
         doEqB = doEq;
         if (proxDistance->load() != 0) { oldProxDistanceB = proxDistance->load(); }
     }
     
-    layerA.setProperty("ffDfEq", var(doEqA), nullptr);
-    layerA.setProperty("oldProxDistance", var(oldProxDistanceA), nullptr);
-    layerB.setProperty("ffDfEq", var(doEqB), nullptr);
-    layerB.setProperty("oldProxDistance", var(oldProxDistanceB), nullptr);
+    StateCodec::State state;
+    getLayerState(abLayerState == 1, layerA, doEqA, oldProxDistanceA, state.layers[0]);
+    getLayerState(abLayerState == 0, layerB, doEqB, oldProxDistanceB, state.layers[1]);
+    state.syncGroup = syncGroupName;
+    
+    StateCodec::write(state, cachedState);
+    destData = cachedState;
+}
+
+void PolarDesignerAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
+{
+    StateCodec::State state;
+    for (auto& layer : state.layers)
+        for (int i = 0; i < StateCodec::NUM_PARAMETERS; ++i)
+            if (auto* param = vtsParams.getParameter(StateCodec::getParameterId(i)))
+                layer.values[i] = param->convertFrom0to1(param->getDefaultValue());
+    
+    stateDirty = true;
+    {
+        // restored parameters don't build filter banks one by one, the final setting is requested once below
+        const ScopedValueSetter<bool> restoring (restoringState, true);
+        if (StateCodec::read(data, sizeInBytes, state))
+        {
+            setBinaryState(state);
+            jassert (isStateRestored(state.layers[0]));
+        }
+        else
+        {
+            setLegacyState(data, sizeInBytes);
+        }
+    }
+    
+    nBands = static_cast<int>(nBandsPtr->load()) + 1;
+    didNRActiveBandsChange = true;
+    zeroDelayModeChanged = true;
+    ffDfEqChanged = true;
+    // opening a session: the kernels of all instances are built on the shared background thread
+    // (equal settings only once), each instance plays the delayed dry signal until its set is ready
+    updateSpectralEngineEq();
+    requestKernelSet(true);
+    repaintDEQ = ALL_BANDS;
+}
+
+// the active layer lives in the parameters, an inactive one in its ValueTree (parameters missing there keep the defaults)
+void PolarDesignerAudioProcessor::getLayerState(bool isActive, const ValueTree& layer, int layerDoEq, float layerOldProxDistance,
+                                                StateCodec::Layer& dest)
+{
+    dest.ffDfEq = layerDoEq;
+    dest.oldProxDistance = layerOldProxDistance;
     
-    ValueTree vtsState = vtsParams.copyState();
-    ValueTree AState = layerA.createCopy();
-    ValueTree BState = layerB.createCopy();
+    for (int i = 0; i < StateCodec::NUM_PARAMETERS; ++i)
+    {
+        const String paramId (StateCodec::getParameterId(i));
+        if (isActive)
+        {
+            dest.values[i] = vtsParams.getRawParameterValue(paramId)->load();
+        }
+        else
+        {
+            auto* param = vtsParams.getParameter(paramId);
+            const ValueTree paramTree = layer.getChildWithProperty("id", paramId);
+            dest.values[i] = paramTree.isValid() ? static_cast<float>(paramTree.getProperty("value"))
+                                                 : param->convertFrom0to1(param->getDefaultValue());
+        }
+    }
+}
+
+// like the xml states: layer A is loaded into the parameters, layer B is kept for switching
+void PolarDesignerAudioProcessor::setBinaryState(const StateCodec::State& state)
+{
+    // the band count goes first, like in applyPreset: the crossovers are normalised with it
+    const StateCodec::Layer& a = state.layers[0];
+    auto restoreValue = [this, &a] (int i)
+    {
+        if (auto* param = vtsParams.getParameter(StateCodec::getParameterId(i)))
+            param->setValueNotifyingHost(param->convertTo0to1(a.values[i]));
+    };
+    
+    const int nrBandsIndex = StateCodec::getParameterIndex("nrBands");
+    restoreValue(nrBandsIndex);
+    for (int i = 0; i < StateCodec::NUM_PARAMETERS; ++i)
+        if (i != nrBandsIndex)
+            restoreValue(i);
+    doEq = a.ffDfEq;
+    oldProxDistance = a.oldProxDistance;
+    
+    const StateCodec::Layer& b = state.layers[1];
+    layerB = vtsParams.copyState();
+    for (int i = 0; i < StateCodec::NUM_PARAMETERS; ++i)
+    {
+        ValueTree paramTree = layerB.getChildWithProperty("id", StateCodec::getParameterId(i));
+        if (paramTree.isValid())
+            paramTree.setProperty("value", b.values[i], nullptr);
+    }
+    doEqB = b.ffDfEq;
+    oldProxDistanceB = b.oldProxDistance;
     
-    saveStates.removeAllChildren(nullptr);
-    saveStates.addChild(vtsState, 0, nullptr);
-    saveStates.addChild(AState, 1, nullptr);
-    saveStates.addChild(BState, 2, nullptr);
+    setSyncGroupName(state.syncGroup);
+}
+
+// round trip check of a restored layer A: the parameters hold its values (as far as their ranges allow),
+// no matter which band count the instance had before
+bool PolarDesignerAudioProcessor::isStateRestored(const StateCodec::Layer& expected)
+{
+    StateCodec::Layer restored;
+    getLayerState(true, layerA, doEq, oldProxDistance, restored);
     
-    std::unique_ptr<XmlElement> xml (saveStates.createXml());
-    copyXmlToBinary (*xml, destData);
+    for (int i = 0; i < StateCodec::NUM_PARAMETERS; ++i)
+    {
+        if (auto* param = vtsParams.getParameter(StateCodec::getParameterId(i)))
+        {
+            const float value = param->convertFrom0to1(param->convertTo0to1(expected.values[i]));
+            const float tolerance = 1.0e-4f * jmax(1.0f, std::abs(value));
+            if (std::abs(restored.values[i] - value) > tolerance)
+                return false;
+        }
+    }
+    return restored.ffDfEq == expected.ffDfEq;
 }
 
-void PolarDesignerAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
+// xml states written by earlier versions
+void PolarDesignerAudioProcessor::setLegacyState(const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
     std::unique_ptr<XmlElement> xmlState (getXmlFromBinary (data, sizeInBytes));
     if (xmlState != nullptr)
     {
@@ -546,6 +676,7 @@ void PolarDesignerAudioProcessor::setStateInformation (const void* data, int siz
             oldProxDistance = static_cast<float>(val.getValue());
         }
     }
+    setSyncGroupName(vtsParams.state.getProperty("syncGroup").toString());
     
     if (layerB.hasProperty("ffDfEq"))
     {
@@ -563,23 +694,17 @@ void PolarDesignerAudioProcessor::setStateInformation (const void* data, int siz
             oldProxDistanceB = static_cast<float>(val.getValue());
         }
     }
-    nBands = static_cast<int>(nBandsPtr->load()) + 1;
-    didNRActiveBandsChange = true;
-    zeroDelayModeChanged = true;
-    ffDfEqChanged = true;
-    computeAllFilterCoefficients();
-    initAllConvolvers();
-    repaintDEQ = true;
 }
 
 void PolarDesignerAudioProcessor::parameterChanged (const String &parameterID, float newValue)
 {
-    if (parameterID.startsWith("xOverF") && !loadingFile)
+    stateDirty = true;
+    
+    if (parameterID.startsWith("xOverF") && !loadingFile && !applyingPatternUpdate)
     {
-        int idx = parameterID.getTrailingIntValue() - 1;
-        computeFilterCoefficients(idx);
-        initConvolver(idx);
-        repaintDEQ = true;
+        // linked instances move their crossovers together and get the same kernel set
+        requestKernelSet(false);
+        repaintDEQ |= 3 << (parameterID.getTrailingIntValue() - 1); // the bands on both sides
     }
     else if (parameterID.startsWith("solo"))
     {
@@ -591,15 +716,15 @@ void PolarDesignerAudioProcessor::parameterChanged (const String &parameterID, f
     }
     else if (parameterID.startsWith("alpha"))
     {
-        repaintDEQ = true;
+        repaintDEQ |= 1 << (parameterID.getTrailingIntValue() - 1);
     }
     else if (parameterID == "nrBands")
     {
         nBands = static_cast<int> (nBandsPtr->load()) + 1;
-        resetXoverFreqs();
+        if (!restoringState) // states, presets and A/B layers bring their own crossovers
+            resetXoverFreqs();
         didNRActiveBandsChange = true;
-        computeAllFilterCoefficients();
-        initAllConvolvers();
+        requestKernelSet(true); // the kernel lane builds it, the old kernels don't fit the new band count
     }
     else if (parameterID == "proximity")
     {
@@ -609,328 +734,796 @@ void PolarDesignerAudioProcessor::parameterChanged (const String &parameterID, f
     {
         updateLatency();
         
+        // restored states and layers bring their own proximity
         if (newValue == 0)
         {
-            if (abLayerState == 0)
-            {
-                vtsParams.getParameter ("proximity")->setValueNotifyingHost (vtsParams.getParameter("proximity")->convertTo0to1(oldProxDistanceB));
-            }
-            else
+            if (!restoringState)
             {
-                vtsParams.getParameter ("proximity")->setValueNotifyingHost (vtsParams.getParameter("proximity")->convertTo0to1(oldProxDistanceA));
+                const float layerProxDistance = abLayerState == 0 ? oldProxDistanceB : oldProxDistanceA;
+                vtsParams.getParameter ("proximity")->setValueNotifyingHost (vtsParams.getParameter("proximity")->convertTo0to1(layerProxDistance));
             }
             zeroDelayModeChanged = true;
-            computeAllFilterCoefficients();
             initAllConvolvers();
         }
         else
         {
-            if (abLayerState == 0 && !abLayerChanged.get())
-            {
-                oldProxDistanceB = proxDistance->load();
-            }
-            else if (abLayerState == 1 && !abLayerChanged.get())
+            if (!restoringState)
             {
-                oldProxDistanceA = proxDistance->load();
+                if (abLayerState == 0 && !abLayerChanged.get())
+                {
+                    oldProxDistanceB = proxDistance->load();
+                }
+                else if (abLayerState == 1 && !abLayerChanged.get())
+                {
+                    oldProxDistanceA = proxDistance->load();
+                }
+                vtsParams.getParameter ("proximity")->setValueNotifyingHost (vtsParams.getParameter("proximity")->convertTo0to1(0));
             }
-            vtsParams.getParameter ("proximity")->setValueNotifyingHost (vtsParams.getParameter("proximity")->convertTo0to1(0));
             zeroDelayModeChanged = true;
         }
     }
-    else if (parameterID == "syncChannel" && syncChannelPtr->load() >= 0.5f)
+    else if (parameterID == "spectralEngine")
     {
-        int ch = (int) syncChannelPtr->load() - 1;
-        ParamsToSync& paramsToSync = sharedParams.get().syncParams.getReference(ch);
-        
-        if (!paramsToSync.paramsValid) // init all params
+        updateLatency();
+        if (newValue >= 0.5f) // the eq of the engine is only kept up to date while it is used
         {
-            for (int i = 0; i < 5; ++i)
-            {
-                paramsToSync.solo[i] = soloBand[i]->load();
-                paramsToSync.mute[i] = muteBand[i]->load();
-                paramsToSync.dirFactors[i] = dirFactors[i]->load();
-                paramsToSync.gains[i] = bandGains[i]->load();
-                
-                if (i < 4)
-                    paramsToSync.xOverFreqs[i] = xOverFreqs[i]->load();
-            }
-            
-            paramsToSync.nrActiveBands = nBandsPtr->load();
-            paramsToSync.proximity = proxDistance->load();
-            
-            paramsToSync.allowBackwardsPattern = allowBackwardsPattern->load();
-            
-            if(!readingSharedParams)
+            if (MessageManager::existsAndIsCurrentThread() || isNonRealtime())
+                updateSpectralEngineEq();
+            else
             {
-                paramsToSync.zeroDelayMode = zeroDelayMode->load();
-                paramsToSync.ffDfEq = doEq;
+                spectralEngineEqRequested = true;
+                triggerAsyncUpdate();
             }
         }
     }
-    
-    // if parameters are synced -> set sharedParams
-    if (syncChannelPtr->load() >= 0.5f && !readingSharedParams)
+    else if (parameterID == "adaptiveMode")
     {
-        int ch = (int) syncChannelPtr->load() - 1;
-        ParamsToSync& paramsToSync = sharedParams.get().syncParams.getReference(ch);
-        
-        if (parameterID.startsWith("xOverF") && !loadingFile)
-        {
-            int idx = parameterID.getTrailingIntValue() - 1;
-            paramsToSync.xOverFreqs[idx] = xOverFreqs[idx]->load();
-        }
-        else if (parameterID.startsWith("solo"))
-        {
-            int idx = parameterID.getTrailingIntValue() - 1;
-            paramsToSync.solo[idx] = soloBand[idx]->load();
-        }
-        else if (parameterID.startsWith("mute"))
-        {
-            int idx = parameterID.getTrailingIntValue() - 1;
-            paramsToSync.mute[idx] = muteBand[idx]->load();
-        }
-        else if (parameterID.startsWith("alpha"))
-        {
-            int idx = parameterID.getTrailingIntValue() - 1;
-            paramsToSync.dirFactors[idx] = dirFactors[idx]->load();
-        }
-        else if (parameterID == "nrBands")
+        if (newValue >= 0.5f)
         {
-            paramsToSync.nrActiveBands = nBandsPtr->load();
-        }
-        else if (parameterID == "proximity")
-        {
-            paramsToSync.proximity = proxDistance->load();
-        }
-        else if (parameterID == "zeroDelayMode")
-        {
-            paramsToSync.zeroDelayMode = zeroDelayMode->load();
-        }
-        else if (parameterID.startsWith("gain"))
-        {
-            int idx = parameterID.getTrailingIntValue() - 1;
-            paramsToSync.gains[idx] = bandGains[idx]->load();
+            // start adapting from the current patterns
+            for (int i = 0; i < 5; ++i)
+                adaptiveAlphas[i] = dirFactors[i]->load();
+            resetAdaptiveStatistics = true;
         }
-        else if (parameterID == "allowBackwardsPattern")
+        else if (!restoringState) // restored states and layers bring their own patterns
         {
-            paramsToSync.allowBackwardsPattern = allowBackwardsPattern->load();
+            // keep the adapted patterns
+            for (int i = 0; i < nBands; ++i)
+                vtsParams.getParameter ("alpha" + String(i+1))->setValueNotifyingHost (vtsParams.getParameter("alpha1")->convertTo0to1 (adaptiveAlphas[i].load()));
+            repaintDEQ = ALL_BANDS;
         }
-        
     }
-}
-
-void PolarDesignerAudioProcessor::setEqState(int idx)
-{
-    doEq = idx;
-    
-    if (syncChannelPtr->load() >= 0.5f && !readingSharedParams)
+    else if (parameterID == "syncChannel")
     {
-        int ch = (int) syncChannelPtr->load() - 1;
-        ParamsToSync& paramsToSync = sharedParams.get().syncParams.getReference(ch);
-        paramsToSync.ffDfEq = doEq;
+        updateSyncSubscription();
     }
-}
-
-void PolarDesignerAudioProcessor::setAbLayer(bool state)
-{
-    abLayerState = state;
-    changeAbLayerState();
-}
-
-void PolarDesignerAudioProcessor::resetXoverFreqs()
-{
-    switch (nBands) {
-        case 1:
-            break;
-            
-        case 2:
-            for (int i = 0; i < nBands - 1; ++i)
+    
+    // if parameters are synced -> publish the change to the other instances
+    SyncChannel<ParamsToSync>* group = syncGroup.load();
+    if (group != nullptr && !readingSharedParams)
+    {
+        group->publish([this, &parameterID] (ParamsToSync& paramsToSync)
+        {
+            if (parameterID.startsWith("xOverF") && !loadingFile)
             {
-                vtsParams.getParameter ("xOverF" + String(i+1))->setValueNotifyingHost (hzToZeroToOne(i, INIT_XOVER_FREQS_2B[i]));
+                int idx = parameterID.getTrailingIntValue() - 1;
+                paramsToSync.xOverFreqs[idx] = xOverFreqs[idx]->load();
             }
-            break;
-            
-        case 3:
-            for (int i = 0; i < nBands - 1; ++i)
+            else if (parameterID.startsWith("solo"))
             {
-                vtsParams.getParameter ("xOverF" + String(i+1))->setValueNotifyingHost (hzToZeroToOne(i, INIT_XOVER_FREQS_3B[i]));
+                int idx = parameterID.getTrailingIntValue() - 1;
+                paramsToSync.solo[idx] = soloBand[idx]->load();
             }
-            break;
-            
-        case 4:
-            for (int i = 0; i < nBands - 1; ++i)
+            else if (parameterID.startsWith("mute"))
             {
-                vtsParams.getParameter ("xOverF" + String(i+1))->setValueNotifyingHost (hzToZeroToOne(i, INIT_XOVER_FREQS_4B[i]));
+                int idx = parameterID.getTrailingIntValue() - 1;
+                paramsToSync.mute[idx] = muteBand[idx]->load();
             }
-            break;
-            
-        case 5:
-            for (int i = 0; i < nBands - 1; ++i)
+            else if (parameterID.startsWith("alpha"))
             {
-                vtsParams.getParameter ("xOverF" + String(i+1))->setValueNotifyingHost (hzToZeroToOne(i, INIT_XOVER_FREQS_5B[i]));
+                int idx = parameterID.getTrailingIntValue() - 1;
+                startLinkedRamp(paramsToSync, idx);
+                paramsToSync.dirFactors[idx] = dirFactors[idx]->load();
             }
-            break;
-            
-        default:
-            jassert(false);
-            break;
+            else if (parameterID == "nrBands")
+            {
+                paramsToSync.nrActiveBands = nBandsPtr->load();
+            }
+            else if (parameterID == "proximity")
+            {
+                paramsToSync.proximity = proxDistance->load();
+            }
+            else if (parameterID == "zeroDelayMode")
+            {
+                paramsToSync.zeroDelayMode = zeroDelayMode->load();
+            }
+            else if (parameterID.startsWith("gain"))
+            {
+                int idx = parameterID.getTrailingIntValue() - 1;
+                startLinkedRamp(paramsToSync, idx);
+                paramsToSync.gains[idx] = bandGains[idx]->load();
+            }
+            else if (parameterID == "allowBackwardsPattern")
+            {
+                paramsToSync.allowBackwardsPattern = allowBackwardsPattern->load();
+            }
+            else
+            {
+                return false; // not synced
+            }
+            return true;
+        }, this);
     }
 }
 
-// compute filter bank filter coeffs and store in firFilterBuffer
-void PolarDesignerAudioProcessor::computeAllFilterCoefficients()
+void PolarDesignerAudioProcessor::setEqState(int idx)
 {
-    for (int i = 0; i < 4; ++i)
+    if (doEq != idx)
+    {
+        doEq = idx;
+        stateDirty = true;
+        // eq is part of the filter bank kernels
+        initAllConvolvers();
+    }
+    
+    SyncChannel<ParamsToSync>* group = syncGroup.load();
+    if (group != nullptr && !readingSharedParams)
     {
-        computeFilterCoefficients(i);
+        group->publish([this] (ParamsToSync& paramsToSync)
+        {
+            if (paramsToSync.ffDfEq == doEq)
+                return false;
+            paramsToSync.ffDfEq = doEq;
+            return true;
+        }, this);
     }
 }
 
-void PolarDesignerAudioProcessor::computeFilterCoefficients(int crossoverNr)
+void PolarDesignerAudioProcessor::setSyncGroupName(const String& name)
 {
-    // only one band: no filtering
-    if (nBands == 1)
+    syncGroupName = name.trim();
+    stateDirty = true;
+    updateSyncSubscription();
+}
+
+String PolarDesignerAudioProcessor::getActiveSyncGroupName()
+{
+    if (syncGroupName.isNotEmpty())
+        return syncGroupName;
+    
+    const int ch = (int) syncChannelPtr->load();
+    return ch > 0 ? String(ch) : String();
+}
+
+// only the group of this instance wakes it up, and only when another member changed something;
+// a joining instance hands its params to the group
+void PolarDesignerAudioProcessor::updateSyncSubscription()
+{
+    const String name = getActiveSyncGroupName();
+    SyncChannel<ParamsToSync>* group = name.isEmpty() ? nullptr : sharedParams->getGroup(name);
+    SyncChannel<ParamsToSync>* previousGroup = syncGroup.load();
+    if (group == previousGroup)
         return;
     
-    // lowest band is simple lowpass
-    if (crossoverNr == 0)
-    {
-        dsp::FilterDesign<float>::FIRCoefficientsPtr lowpass = dsp::FilterDesign<float>::designFIRLowpassWindowMethod(hzFromZeroToOne(0, xOverFreqs[0]->load()), currentSampleRate, firLen - 1, dsp::WindowingFunction<float>::WindowingMethod::hamming);
-        float* lpCoeffs = lowpass->getRawCoefficients();
-        firFilterBuffer.copyFrom(0, 0, lpCoeffs, firLen);
-    }
+    if (previousGroup != nullptr)
+        previousGroup->unsubscribe(this);
     
-    // all the other bands are bandpass filters
-    for (int i = std::max(1, crossoverNr); i < std::min(crossoverNr + 2, nBands - 1); ++i)
-    {
-        float halfBandwidth = (hzFromZeroToOne(i, xOverFreqs[i]->load()) - hzFromZeroToOne(i-1, xOverFreqs[i-1]->load())) / 2;
-        dsp::FilterDesign<float>::FIRCoefficientsPtr lp2bp = dsp::FilterDesign<float>::designFIRLowpassWindowMethod(halfBandwidth, currentSampleRate, firLen - 1, dsp::WindowingFunction<float>::WindowingMethod::hamming);
-        float* lp2bpCoeffs = lp2bp->getRawCoefficients();
-        auto* filterBufferPointer = firFilterBuffer.getWritePointer(i);
-        for (int j=0; j<firLen; j++) // bandpass transform
-        {
-            float fCenter = halfBandwidth + hzFromZeroToOne(i-1, xOverFreqs[i-1]->load());
-            // write bandpass transformed fir coeffs to buffer
-            *(filterBufferPointer+j) = 2 * *(lp2bpCoeffs+j) * std::cosf(MathConstants<float>::twoPi * fCenter / currentSampleRate * (j - (firLen - 1) / 2));
-        }
-    }
+    appliedSyncVersion = 1;
+    syncGroup = group;
     
-    if (crossoverNr == nBands - 2)
+    if (group != nullptr)
     {
-        // highest band is highpass (via frequency transform)
-        float hpBandwidth = currentSampleRate / 2 - hzFromZeroToOne(nBands - 2, xOverFreqs[nBands-2]->load());
-        auto* filterBufferPointer = firFilterBuffer.getWritePointer(nBands-1);
-        dsp::FilterDesign<float>::FIRCoefficientsPtr lp2hp = dsp::FilterDesign<float>::designFIRLowpassWindowMethod(hpBandwidth, currentSampleRate, firLen - 1, dsp::WindowingFunction<float>::WindowingMethod::hamming);
-        float* lp2hpCoeffs = lp2hp->getRawCoefficients();
-        for (int i=0; i<firLen; ++i) // highpass transform
-        {
-            *(filterBufferPointer+i) = *(lp2hpCoeffs+i) * std::cosf(MathConstants<float>::pi * (i - (firLen - 1) / 2));
-        }
+        group->subscribe(this);
+        publishAllSyncParams();
     }
-    
 }
 
-void PolarDesignerAudioProcessor::initAllConvolvers()
+void PolarDesignerAudioProcessor::publishAllSyncParams()
 {
-    convolversReady = false;
+    SyncChannel<ParamsToSync>* group = syncGroup.load();
+    if (group == nullptr)
+        return;
     
-    // build filters and fill firFilterBuffer
-    dsp::AudioBlock<float> convBlk (firFilterBuffer);
-    dsp::ProcessSpec convSpec {currentSampleRate, static_cast<uint32>(currentBlockSize), 1};
-    for (int i = 0; i < nBands; ++i) // prepare nBands mono convolvers
+    group->publish([this] (ParamsToSync& paramsToSync)
     {
-        AudioBuffer<float> convSingleBuffOmni(1, firLen);
-        convSingleBuffOmni.copyFrom(0, 0, firFilterBuffer, i, 0, firLen);
+        for (int i = 0; i < 5; ++i)
+        {
+            paramsToSync.solo[i] = soloBand[i]->load();
+            paramsToSync.mute[i] = muteBand[i]->load();
+            paramsToSync.dirFactors[i] = dirFactors[i]->load();
+            paramsToSync.gains[i] = bandGains[i]->load();
+            
+            // no ramp pending: start from the own values
+            getBandCoefficients(paramsToSync.dirFactors[i], paramsToSync.gains[i], paramsToSync.rampFromOmni[i], paramsToSync.rampFromEight[i]);
+            paramsToSync.rampStart[i] = -1;
+            
+            if (i < 4)
+                paramsToSync.xOverFreqs[i] = xOverFreqs[i]->load();
+        }
         
-        AudioBuffer<float> convSingleBuffEight(1, firLen);
-        convSingleBuffEight.copyFrom(0, 0, firFilterBuffer, i, 0, firLen);
+        paramsToSync.nrActiveBands = nBandsPtr->load();
+        paramsToSync.proximity = proxDistance->load();
         
-        // omni convolver
-        convolvers[2 * i].prepare (convSpec); // must be called before loading IR
-        convolvers[2 * i].loadImpulseResponse(std::move(convSingleBuffOmni), currentSampleRate, Convolution::Stereo::no, Convolution::Trim::no, Convolution::Normalise::no);
+        paramsToSync.allowBackwardsPattern = allowBackwardsPattern->load();
         
-        // eight convolver
-        convolvers[2 * i + 1].prepare (convSpec); // must be called before loading IR
-        convolvers[2 * i + 1].loadImpulseResponse(std::move(convSingleBuffEight), currentSampleRate, Convolution::Stereo::no, Convolution::Trim::no, Convolution::Normalise::no);
-    }
-    convolversReady = true;
+        if(!readingSharedParams)
+        {
+            paramsToSync.zeroDelayMode = zeroDelayMode->load();
+            paramsToSync.ffDfEq = doEq;
+        }
+        
+        paramsToSync.paramsValid = true;
+        return true;
+    }, this);
 }
 
-void PolarDesignerAudioProcessor::initConvolver(int convNr)
+// called before the new alpha / gain of a band is published: the ramp of all members starts at the
+// next block of this instance, from where the current ramp is at that moment
+void PolarDesignerAudioProcessor::startLinkedRamp(ParamsToSync& paramsToSync, int bandNr)
 {
-    convolversReady = false;
-    
-    // build filters and fill firFilterBuffer
-    dsp::AudioBlock<float> convBlk (firFilterBuffer);
-    dsp::ProcessSpec convSpec {currentSampleRate, static_cast<uint32>(currentBlockSize), 1};
+    const int64 rampStart = nextBlockTimelineStart.load();
+    float omni, eight;
+    getLinkedCoefficients(paramsToSync, bandNr, rampStart, omni, eight);
     
-    // update two convolvers: if one crossover frequency changes, two neighbouring bands need new filters
-    for (int i = convNr; i < convNr + 2; ++i)
-    {
-        AudioBuffer<float> convSingleBuffOmni(1, firLen);
-        convSingleBuffOmni.copyFrom(0, 0, firFilterBuffer, i, 0, firLen);
-        
-        AudioBuffer<float> convSingleBuffEight(1, firLen);
-        convSingleBuffEight.copyFrom(0, 0, firFilterBuffer, i, 0, firLen);
-        
-        // omni convolver
-        convolvers[2 * i].prepare (convSpec); // must be called before loading IR
-        convolvers[2 * i].loadImpulseResponse(std::move(convSingleBuffOmni), currentSampleRate, Convolution::Stereo::no, Convolution::Trim::no, Convolution::Normalise::no);
-        
-        // eight convolver
-        convolvers[2 * i + 1].prepare (convSpec); // must be called before loading IR
-        convolvers[2 * i + 1].loadImpulseResponse(std::move(convSingleBuffEight), currentSampleRate, Convolution::Stereo::no, Convolution::Trim::no, Convolution::Normalise::no);
-    }
-    convolversReady = true;
+    paramsToSync.rampFromOmni[bandNr] = omni;
+    paramsToSync.rampFromEight[bandNr] = eight;
+    paramsToSync.rampStart[bandNr] = rampStart;
 }
 
-void PolarDesignerAudioProcessor::createOmniAndEightSignals (AudioBuffer<float>& buffer)
+int PolarDesignerAudioProcessor::getLinkedRampLength()
 {
-    int numSamples = buffer.getNumSamples();
-    // calculate omni part
-    const float* readPointerFront = buffer.getReadPointer (0);
-    const float* readPointerBack = buffer.getReadPointer (1);
-    float* writePointerOmni = omniEightBuffer.getWritePointer (0);
-    FloatVectorOperations::copy (writePointerOmni, readPointerFront, numSamples);
-    FloatVectorOperations::add (writePointerOmni, readPointerBack, numSamples);
-    
-    // calculate fig-of-eight part
-    float* writePointerEight = omniEightBuffer.getWritePointer (1);
-    FloatVectorOperations::copy (writePointerEight, readPointerFront, numSamples);
-    FloatVectorOperations::subtract (writePointerEight, readPointerBack, numSamples);
+    return jmax(1, roundToInt(LINKED_RAMP_SECONDS * currentSampleRate));
 }
 
-void PolarDesignerAudioProcessor::createPolarPatterns(AudioBuffer<float>& buffer)
+void PolarDesignerAudioProcessor::getBandCoefficients(float dirFactor, float gainDb, float& omni, float& eight)
 {
-    int numSamples = buffer.getNumSamples();
-    buffer.clear();
+    const float gain = Decibels::decibelsToGain(gainDb, -59.91f);
+    omni = (1 - std::abs (dirFactor)) * gain;
+    eight = dirFactor * gain;
+}
+
+// Mixing coefficients of a band at a host timeline sample. They only depend on the snapshot and the
+// timeline, so all members of a group produce the same ramp, no matter how the host splits the blocks.
+void PolarDesignerAudioProcessor::getLinkedCoefficients(const ParamsToSync& paramsToSync, int bandNr, int64 timelineSample,
+                                                        float& omni, float& eight)
+{
+    getBandCoefficients(paramsToSync.dirFactors[bandNr], paramsToSync.gains[bandNr], omni, eight);
     
-    int nActiveBands = nBands;
-    if (zeroDelayMode->load() > 0.5f)
-        nActiveBands = 1;
+    const int64 rampStart = paramsToSync.rampStart[bandNr];
+    const int rampLength = getLinkedRampLength();
+    if (rampStart < 0 || timelineSample < 0 || timelineSample >= rampStart + rampLength
+        || rampStart == finishedRampStart[bandNr].load()) // the transport jumped since the ramp was started
+        return;
     
-    for (int i = 0; i < nActiveBands; ++i)
-    {
-        if ((muteBand[i]->load() > 0.5 && soloBand[i]->load() < 0.5) || (soloActive && soloBand[i]->load() < 0.5))
-            continue;
+    // before its start the ramp holds the old values
+    const float progress = jmax(0.0f, static_cast<float>(timelineSample - rampStart) / rampLength);
+    omni = paramsToSync.rampFromOmni[bandNr] + progress * (omni - paramsToSync.rampFromOmni[bandNr]);
+    eight = paramsToSync.rampFromEight[bandNr] + progress * (eight - paramsToSync.rampFromEight[bandNr]);
+}
+
+void PolarDesignerAudioProcessor::setAbLayer(bool state)
+{
+    abLayerState = state;
+    changeAbLayerState();
+}
+
+void PolarDesignerAudioProcessor::resetXoverFreqs()
+{
+    const BandConfig& config = BandConfigs::get(nBands);
+    for (int i = 0; i < nBands - 1; ++i)
+    {
+        vtsParams.getParameter ("xOverF" + String(i+1))->setValueNotifyingHost (config.hzToZeroToOne(i, config.initXoverFreqs[i]));
+    }
+}
+
+// filter bank setting of the convolvers, partitionSize = 0: not prepared yet
+KernelSetKey PolarDesignerAudioProcessor::getKernelSetKey(int partitionSize)
+{
+    KernelSetKey key;
+    key.sampleRate = currentSampleRate;
+    key.partitionSize = partitionSize;
+    key.firLen = firLen;
+    key.nBands = nBands;
+    key.eqMode = eqActive() ? doEq : 0;
+    for (int i = 0; i < nBands - 1; ++i)
+        key.xoverHz[i] = hzFromZeroToOne(i, xOverFreqs[i]->load());
+    return key;
+}
+
+// filter bank filter coefficients of one band, firLen values
+void PolarDesignerAudioProcessor::designBandFilter(const KernelSetKey& key, int bandNr, float* coefficients)
+{
+    const int firLen = key.firLen;
+    const double sampleRate = key.sampleRate;
+    
+    if (bandNr == 0)
+    {
+        // lowest band is simple lowpass
+        dsp::FilterDesign<float>::FIRCoefficientsPtr lowpass = dsp::FilterDesign<float>::designFIRLowpassWindowMethod(key.xoverHz[0], sampleRate, firLen - 1, dsp::WindowingFunction<float>::WindowingMethod::hamming);
+        FloatVectorOperations::copy(coefficients, lowpass->getRawCoefficients(), firLen);
+    }
+    else if (bandNr == key.nBands - 1)
+    {
+        // highest band is highpass (via frequency transform)
+        float hpBandwidth = sampleRate / 2 - key.xoverHz[bandNr - 1];
+        dsp::FilterDesign<float>::FIRCoefficientsPtr lp2hp = dsp::FilterDesign<float>::designFIRLowpassWindowMethod(hpBandwidth, sampleRate, firLen - 1, dsp::WindowingFunction<float>::WindowingMethod::hamming);
+        float* lp2hpCoeffs = lp2hp->getRawCoefficients();
+        for (int i=0; i<firLen; ++i) // highpass transform
+        {
+            coefficients[i] = lp2hpCoeffs[i] * std::cosf(MathConstants<float>::pi * (i - (firLen - 1) / 2));
+        }
+    }
+    else
+    {
+        // all the other bands are bandpass filters
+        float halfBandwidth = (key.xoverHz[bandNr] - key.xoverHz[bandNr-1]) / 2;
+        float fCenter = halfBandwidth + key.xoverHz[bandNr-1];
+        dsp::FilterDesign<float>::FIRCoefficientsPtr lp2bp = dsp::FilterDesign<float>::designFIRLowpassWindowMethod(halfBandwidth, sampleRate, firLen - 1, dsp::WindowingFunction<float>::WindowingMethod::hamming);
+        float* lp2bpCoeffs = lp2bp->getRawCoefficients();
+        for (int j=0; j<firLen; j++) // bandpass transform
+        {
+            coefficients[j] = 2 * lp2bpCoeffs[j] * std::cosf(MathConstants<float>::twoPi * fCenter / sampleRate * (j - (firLen - 1) / 2));
+        }
+    }
+}
+
+// kernel impulse response of one band and channel (0 = omni, 1 = eight): band filter combined with the ff/df eq.
+// Only depends on its arguments, so the kernel store can call it from the background thread.
+void PolarDesignerAudioProcessor::designBandImpulseResponse(const KernelSetKey& key, const EqImpulseResponseCache::ImpulseResponses& eqResponses,
+                                                            int bandNr, int ch, AudioBuffer<float>& ir)
+{
+    if (key.eqMode == 0)
+    {
+        ir.setSize(1, key.firLen);
+        designBandFilter(key, bandNr, ir.getWritePointer(0));
+        return;
+    }
+    
+    const auto eqType = key.eqMode == 1 ? EqImpulseResponseCache::freeField : EqImpulseResponseCache::diffuseField;
+    const AudioBuffer<float>& eq = ch == 0 ? eqResponses.getOmni(eqType) : eqResponses.getEight(eqType);
+    
+    if (key.nBands == 1) // no filter bank: the kernel is the plain eq response
+    {
+        ir.makeCopyOf(eq);
+        return;
+    }
+    
+    HeapBlock<float> bandFilter (key.firLen);
+    designBandFilter(key, bandNr, bandFilter);
+    convolveImpulseResponses(bandFilter, key.firLen, eq.getReadPointer(0), eq.getNumSamples(), ir);
+}
+
+KernelSet::Ptr PolarDesignerAudioProcessor::buildKernelSet(KernelStore& store, const KernelSetKey& key,
+                                                           EqImpulseResponseCache::ImpulseResponses::Ptr eq)
+{
+    return store.getKernelSet(key, [&key, &eq] (int bandNr, int ch, AudioBuffer<float>& ir)
+    {
+        designBandImpulseResponse(key, *eq, bandNr, ch, ir);
+    });
+}
+
+// message thread: builds the kernel set right away (band count or eq changed). Automation on other threads
+// only requests it, the delayed dry signal plays until the kernel lane has built it.
+void PolarDesignerAudioProcessor::initAllConvolvers()
+{
+    if (restoringState) // setStateInformation() and applyPreset() ask for the final setting once
+        return;
+    
+    if (!MessageManager::existsAndIsCurrentThread())
+    {
+        requestKernelSet(true);
+        return;
+    }
+    
+    const int serial = ++kernelSetSerial; // a pending background build is outdated now
+    const KernelSetKey key = getKernelSetKey(convolvers[0].getPartitionSize());
+    if (key.partitionSize > 0)
+        applyKernelSet(needsKernels() ? buildKernelSet(*kernelStore, key, eqResponses) : nullptr, serial);
+    
+    updateSpectralEngineEq();
+}
+
+// the spectral engine applies the eq per bin; only while it is active, switching it on updates the eq
+void PolarDesignerAudioProcessor::updateSpectralEngineEq()
+{
+    if (!spectralEngineActive())
+        return;
+    
+    if (eqActive())
+    {
+        const auto eqType = doEq == 1 ? EqImpulseResponseCache::freeField : EqImpulseResponseCache::diffuseField;
+        spectralEngine.setEq(&eqResponses->getOmni(eqType), &eqResponses->getEight(eqType));
+    }
+    else
+    {
+        spectralEngine.setEq(nullptr, nullptr);
+    }
+}
+
+// Crossover moved, state restored or convolvers prepared: the kernel set is built on the shared background
+// thread. Meanwhile the convolvers keep the old kernels, or with playDryUntilReady processBlock() plays the
+// delayed dry signal. Only the latest request of an instance is built; linked instances (or the instances of
+// a session sharing a setting) ask for the same set, the first one builds it and the others find it in the store.
+// Offline renders don't wait for the background thread: the set is built right away, on the calling thread.
+void PolarDesignerAudioProcessor::requestKernelSet(bool playDryUntilReady)
+{
+    if (restoringState) // setStateInformation() and applyPreset() ask for the final setting once
+        return;
+    
+    if (playDryUntilReady)
+        convolversReady = false;
+    
+    if (!MessageManager::existsAndIsCurrentThread()) // automation, host threads: handled in handleAsyncUpdate()
+    {
+        if (isNonRealtime())
+        {
+            // only the convolvers' pending slots are written here, the set itself stays in the store
+            ++kernelSetSerial; // a pending background build is outdated now
+            const KernelSetKey key = getKernelSetKey(convolvers[0].getPartitionSize());
+            if (key.partitionSize > 0)
+            {
+                setConvolverKernels(needsKernels() ? buildKernelSet(*kernelStore, key, eqResponses) : nullptr);
+                convolversReady = true;
+            }
+        }
         
-        // calculate patterns and add to output buffer
-        const float* readPointerOmni = filterBankBuffer.getReadPointer (2 * i);
-        const float* readPointerEight = filterBankBuffer.getReadPointer (2 * i + 1);
+        kernelSetRequested = true; // the message thread takes the set over and updates the other layer
+        triggerAsyncUpdate();
+        return;
+    }
+    
+    const int serial = ++kernelSetSerial;
+    const KernelSetKey key = getKernelSetKey(convolvers[0].getPartitionSize());
+    if (key.partitionSize == 0)
+        return;
+    
+    if (!needsKernels())
+    {
+        applyKernelSet(nullptr, serial);
+        return;
+    }
+    
+    if (auto existing = kernelStore->findKernelSet(key))
+    {
+        applyKernelSet(existing, serial);
+        return;
+    }
+    
+    if (isNonRealtime())
+    {
+        applyKernelSet(buildKernelSet(*kernelStore, key, eqResponses), serial);
+        return;
+    }
+    
+    const EqImpulseResponseCache::ImpulseResponses::Ptr eq = eqResponses;
+    kernelTasks.run([this, key, eq, serial] (const std::atomic<bool>& cancelled) -> std::function<void()>
+    {
+        if (cancelled || serial != kernelSetSerial.load()) // superseded while waiting
+            return {};
         
-        float oldGain = Decibels::decibelsToGain(oldBandGains[i], -59.91f);
-        float gain = Decibels::decibelsToGain(bandGains[i]->load(), -59.91f);
+        KernelSet::Ptr newKernelSet = buildKernelSet(*kernelStore, key, eq);
+        return [this, newKernelSet, serial] { applyKernelSet(newKernelSet, serial); };
+    });
+}
+
+// message thread: hands the kernels to the convolvers (nullptr: nothing to convolve, see processBlock()),
+// unless a newer set was requested meanwhile
+void PolarDesignerAudioProcessor::applyKernelSet(KernelSet::Ptr newKernelSet, int serial)
+{
+    if (serial != kernelSetSerial.load() || (newKernelSet != nullptr && newKernelSet->getKey().nBands != nBands))
+        return;
+    
+    setConvolverKernels(newKernelSet);
+    kernelSet = newKernelSet;
+    convolversReady = true;
+    requestOtherLayerKernelSet();
+}
+
+// any thread: the convolvers take the kernels from their pending slots and fade to them at their next partition,
+// they ignore a set they already have
+void PolarDesignerAudioProcessor::setConvolverKernels(KernelSet::Ptr newKernelSet)
+{
+    for (int bandNr = 0; bandNr < nBands; ++bandNr)
+        for (int ch = 0; ch < 2; ++ch) // omni, eight
+            convolvers[2 * bandNr + ch].setKernel(newKernelSet != nullptr ? newKernelSet->getKernel(bandNr, ch) : nullptr);
+}
+
+// filter bank setting of the inactive A/B layer, false if that layer has never been stored
+bool PolarDesignerAudioProcessor::getOtherLayerKernelSetKey(KernelSetKey& key)
+{
+    const ValueTree& layer = abLayerState == 1 ? layerB : layerA;
+    const int layerDoEq = abLayerState == 1 ? doEqB : doEqA;
+    const ValueTree bandsTree = layer.getChildWithProperty("id", "nrBands");
+    if (!bandsTree.isValid())
+        return false;
+    
+    key = getKernelSetKey(convolvers[0].getPartitionSize());
+    key.nBands = jlimit(1, 5, static_cast<int>(bandsTree.getProperty("value")) + 1);
+    key.eqMode = layerDoEq == 1 || layerDoEq == 2 ? layerDoEq : 0;
+    const BandConfig& config = BandConfigs::get(key.nBands);
+    for (int i = 0; i < 4; ++i)
+    {
+        const ValueTree xoverTree = layer.getChildWithProperty("id", "xOverF" + String(i+1));
+        key.xoverHz[i] = i < key.nBands - 1 && xoverTree.isValid()
+                       ? config.hzFromZeroToOne(i, static_cast<float>(xoverTree.getProperty("value"))) : 0.0f;
+    }
+    return key.partitionSize > 0;
+}
+
+// keeps the kernels of the inactive layer resident, so switching layers never designs anything
+// and the A/B morph can run both layers. It reads the layer ValueTrees and schedules builds: called from
+// another thread (automation), it is handed to handleAsyncUpdate().
+void PolarDesignerAudioProcessor::requestOtherLayerKernelSet()
+{
+    if (!MessageManager::existsAndIsCurrentThread())
+    {
+        otherLayerKernelSetRequested = true;
+        triggerAsyncUpdate();
+        return;
+    }
+    
+    KernelSetKey key;
+    if (!getOtherLayerKernelSetKey(key) || (key.nBands == 1 && key.eqMode == 0))
+    {
+        setOtherLayerKernelSet(nullptr);
+    }
+    else if (otherLayerKernelSet == nullptr || otherLayerKernelSet->getKey() != key)
+    {
+        setOtherLayerKernelSet(kernelStore->findKernelSet(key));
+        if (otherLayerKernelSet == nullptr && isNonRealtime()) // offline: the morph has both layers right away
+        {
+            setOtherLayerKernelSet(buildKernelSet(*kernelStore, key, eqResponses));
+        }
+        else if (otherLayerKernelSet == nullptr)
+        {
+            const EqImpulseResponseCache::ImpulseResponses::Ptr eq = eqResponses;
+            kernelTasks.run([this, key, eq] (const std::atomic<bool>& cancelled) -> std::function<void()>
+            {
+                if (cancelled)
+                    return {};
+                
+                KernelSet::Ptr newKernelSet = buildKernelSet(*kernelStore, key, eq);
+                return [this, newKernelSet]
+                {
+                    KernelSetKey currentKey;
+                    if (getOtherLayerKernelSetKey(currentKey) && currentKey == newKernelSet->getKey())
+                    {
+                        setOtherLayerKernelSet(newKernelSet);
+                        updateMorphLayer();
+                    }
+                };
+            });
+        }
+    }
+    
+    updateMorphLayer();
+}
+
+// the morph filter bank always holds the kernels of the inactive layer
+void PolarDesignerAudioProcessor::setOtherLayerKernelSet(KernelSet::Ptr newKernelSet)
+{
+    otherLayerKernelSet = newKernelSet;
+    
+    const int numBands = newKernelSet != nullptr ? newKernelSet->getKey().nBands : 0;
+    for (int bandNr = 0; bandNr < 5; ++bandNr)
+        for (int ch = 0; ch < 2; ++ch) // omni, eight
+            morphConvolvers[2 * bandNr + ch].setKernel(bandNr < numBands ? newKernelSet->getKernel(bandNr, ch) : nullptr);
+}
+
+// message thread: patterns and proximity of the inactive layer for the audio thread
+void PolarDesignerAudioProcessor::updateMorphLayer()
+{
+    jassert (MessageManager::existsAndIsCurrentThread()); // reads the layer ValueTrees
+    
+    const ValueTree& layer = abLayerState == 1 ? layerB : layerA;
+    auto getValue = [&layer] (const String& paramID)
+    {
+        return static_cast<float>(layer.getChildWithProperty("id", paramID).getProperty("value", 0.0f));
+    };
+    
+    KernelSetKey key;
+    const bool isStored = getOtherLayerKernelSetKey(key);
+    
+    MorphLayer newLayer;
+    newLayer.nBands = key.nBands;
+    newLayer.applyKernels = key.nBands > 1 || key.eqMode != 0;
+    newLayer.ready = isStored && (!newLayer.applyKernels || (otherLayerKernelSet != nullptr && otherLayerKernelSet->getKey() == key));
+    newLayer.proximity = getValue("proximity");
+    
+    bool layerSoloActive = false;
+    for (int i = 0; i < newLayer.nBands; ++i)
+        layerSoloActive = layerSoloActive || getValue("solo" + String(i+1)) >= 0.5f;
+    
+    for (int i = 0; i < newLayer.nBands; ++i)
+    {
+        const bool solo = getValue("solo" + String(i+1)) >= 0.5f;
+        newLayer.muted[i] = (getValue("mute" + String(i+1)) >= 0.5f && !solo) || (layerSoloActive && !solo);
+        newLayer.dirFactors[i] = getValue("alpha" + String(i+1));
+        newLayer.gains[i] = getValue("gain" + String(i+1));
+    }
+    
+    const dsp::IIR::Coefficients<float> proxCoefficients = getProxCompCoefficients(newLayer.proximity, currentSampleRate);
+    jassert (proxCoefficients.coefficients.size() == 3); // first order
+    std::copy_n(proxCoefficients.coefficients.begin(), 3, newLayer.proxCoefficients);
+    
+    morphLayerChannel.publish([&newLayer] (MorphLayer& morph)
+    {
+        morph = newLayer;
+        return true;
+    });
+}
+
+// longest kernel: band filter convolved with the longest eq response
+int PolarDesignerAudioProcessor::getMaxKernelLength()
+{
+    return firLen + eqResponses->getMaxLength() - 1;
+}
+
+bool PolarDesignerAudioProcessor::eqActive()
+{
+    return doEq == 1 || doEq == 2;
+}
+
+// with one band and no eq the bands are the plain omni and eight signals
+bool PolarDesignerAudioProcessor::needsKernels()
+{
+    return nBands > 1 || eqActive();
+}
+
+// full linear convolution of two impulse responses (via fft), result length is lenA + lenB - 1
+void PolarDesignerAudioProcessor::convolveImpulseResponses(const float* irA, int lenA, const float* irB, int lenB, AudioBuffer<float>& dest)
+{
+    const int resultLen = lenA + lenB - 1;
+    dsp::FFT fft (roundToInt(std::log2(nextPowerOfTwo(resultLen))));
+    const int fftSize = fft.getSize();
+    
+    HeapBlock<float> spectrumA (2 * fftSize, true);
+    HeapBlock<float> spectrumB (2 * fftSize, true);
+    FloatVectorOperations::copy(spectrumA, irA, lenA);
+    FloatVectorOperations::copy(spectrumB, irB, lenB);
+    
+    fft.performRealOnlyForwardTransform(spectrumA);
+    fft.performRealOnlyForwardTransform(spectrumB);
+    
+    auto* binsA = reinterpret_cast<std::complex<float>*>(spectrumA.get());
+    auto* binsB = reinterpret_cast<std::complex<float>*>(spectrumB.get());
+    for (int i = 0; i < fftSize; ++i)
+        binsA[i] *= binsB[i];
+    
+    fft.performRealOnlyInverseTransform(spectrumA);
+    
+    dest.setSize(1, resultLen);
+    dest.copyFrom(0, 0, spectrumA, resultLen);
+}
+
+void PolarDesignerAudioProcessor::createOmniAndEightSignals (AudioBuffer<float>& buffer)
+{
+    int numSamples = buffer.getNumSamples();
+    // calculate omni part
+    const float* readPointerFront = buffer.getReadPointer (0);
+    const float* readPointerBack = buffer.getReadPointer (1);
+    float* writePointerOmni = omniEightBuffer.getWritePointer (0);
+    FloatVectorOperations::copy (writePointerOmni, readPointerFront, numSamples);
+    FloatVectorOperations::add (writePointerOmni, readPointerBack, numSamples);
+    
+    // calculate fig-of-eight part
+    float* writePointerEight = omniEightBuffer.getWritePointer (1);
+    FloatVectorOperations::copy (writePointerEight, readPointerFront, numSamples);
+    FloatVectorOperations::subtract (writePointerEight, readPointerBack, numSamples);
+}
+
+// audio thread: true while the other A/B layer is mixed in, only then its filter bank runs
+bool PolarDesignerAudioProcessor::updateMorph()
+{
+    morphLayerChannel.read(morphLayer);
+    std::copy_n(morphLayer.proxCoefficients, 3, morphProxIIR.coefficients->getRawCoefficients()); // same order, no allocation
+    if (morphLayer.ready && zeroDelayMode->load() < 0.5f && !spectralEngineActive())
+        morphAmount.setTargetValue(abMorph->load());
+    else if (morphLayer.ready) // these modes change the latency anyway, no ramp needed
+        morphAmount.setCurrentAndTargetValue(0.0f);
+    else
+        morphAmount.setTargetValue(0.0f);
+    
+    const bool morphing = morphAmount.isSmoothing() || morphAmount.getTargetValue() > 0.0f;
+    if (morphing && !morphActive) // starts from silence, the rising morph amount hides the convolvers filling up
+    {
+        for (auto& conv : morphConvolvers)
+            conv.reset();
+        morphProxIIR.reset();
+    }
+    morphActive = morphing;
+    return morphing;
+}
+
+// The other layer runs through its own filter bank (its crossovers and eq), proximity filter and patterns,
+// the result is crossfaded with the active layer per sample. The cost is bounded by the second filter bank.
+void PolarDesignerAudioProcessor::mixMorphLayer (AudioBuffer<float>& buffer)
+{
+    const int numSamples = buffer.getNumSamples();
+    const MorphLayer& layer = morphLayer;
+    
+    if (layer.proximity < -0.05f || layer.proximity > 0.05f) // eight (reduce) or omni (boost)
+    {
+        float* writePointer = morphOmniEightBuffer.getWritePointer (layer.proximity < 0.0f ? 1 : 0);
+        dsp::AudioBlock<float> proxBlock (&writePointer, 1, numSamples);
+        dsp::ProcessContextReplacing<float> proxContext (proxBlock);
+        morphProxIIR.process (proxContext);
+    }
+    
+    morphOutputBuffer.clear();
+    for (int i = 0; i < layer.nBands; ++i)
+    {
+        for (int ch = 0; ch < 2; ++ch) // omni, eight
+        {
+            morphBankBuffer.copyFrom (ch, 0, morphOmniEightBuffer, ch, 0, numSamples);
+            if (layer.applyKernels)
+            {
+                float* writePointer = morphBankBuffer.getWritePointer (ch);
+                dsp::AudioBlock<float> bandBlock (&writePointer, 1, numSamples);
+                dsp::ProcessContextReplacing<float> bandContext (bandBlock);
+                morphConvolvers[2 * i + ch].process (bandContext);
+            }
+        }
         
-        // add with ramp to prevent crackling noises
-        buffer.addFromWithRamp(0, 0, readPointerOmni, numSamples,
-                               (1 - std::abs (oldDirFactors[i])) * oldGain,
-                               (1 - std::abs (dirFactors[i]->load())) * gain);
-        buffer.addFromWithRamp(0, 0, readPointerEight, numSamples,
-                               oldDirFactors[i] * oldGain,
-                               dirFactors[i]->load() * gain);
+        if (layer.muted[i])
+            continue;
         
-        oldDirFactors[i] = dirFactors[i]->load();
-        oldBandGains[i] = bandGains[i]->load();
+        float omni, eight;
+        getBandCoefficients (layer.dirFactors[i], layer.gains[i], omni, eight);
+        morphOutputBuffer.addFrom (0, 0, morphBankBuffer, 0, 0, numSamples, omni);
+        morphOutputBuffer.addFrom (0, 0, morphBankBuffer, 1, 0, numSamples, eight);
+    }
+    
+    if (layer.nBands == 1) // same latency as the filter bank, see createPolarPatterns()
+    {
+        dsp::AudioBlock<float> delayBlock (morphOutputBuffer);
+        dsp::ProcessContextReplacing<float> delayContext (delayBlock);
+        morphDelay.process (delayContext);
+    }
+    
+    float* output = buffer.getWritePointer (0);
+    const float* other = morphOutputBuffer.getReadPointer (0);
+    for (int i = 0; i < numSamples; ++i)
+    {
+        const float amount = morphAmount.getNextValue();
+        output[i] += amount * (other[i] - output[i]);
+    }
+}
+
+// kernels not ready yet (e.g. while a session is opened): the omni signal, delayed like the filter bank output
+void PolarDesignerAudioProcessor::createDelayedDryOutput (AudioBuffer<float>& buffer)
+{
+    int numSamples = buffer.getNumSamples();
+    buffer.clear();
+    
+    // delay needs to be running constantly to prevent clicks
+    delayBuffer.copyFrom(0, 0, omniEightBuffer, 0, 0, numSamples);
+    dsp::AudioBlock<float> delayBlock(delayBuffer);
+    dsp::ProcessContextReplacing<float> delayContext(delayBlock);
+    delay.process(delayContext);
+    buffer.copyFrom(0, 0, delayBuffer, 0, 0, numSamples);
+    
+    if (buffer.getNumChannels() == 2 && getMainBusNumOutputChannels() == 2)
+        buffer.copyFrom(1, 0, buffer, 0, 0, numSamples);
+}
+
+void PolarDesignerAudioProcessor::createPolarPatterns(AudioBuffer<float>& buffer)
+{
+    int numSamples = buffer.getNumSamples();
+    buffer.clear();
+    
+    int nActiveBands = nBands;
+    if (zeroDelayMode->load() > 0.5f)
+        nActiveBands = 1;
+    
+    switch (nActiveBands)
+    {
+        case 1: mixBands<1> (buffer); break;
+        case 2: mixBands<2> (buffer); break;
+        case 3: mixBands<3> (buffer); break;
+        case 4: mixBands<4> (buffer); break;
+        case 5: mixBands<5> (buffer); break;
+        default: jassertfalse; break;
     }
     
     // delay needs to be running constantly to prevent clicks
@@ -943,12 +1536,183 @@ void PolarDesignerAudioProcessor::createPolarPatterns(AudioBuffer<float>& buffer
         buffer.copyFrom(0, 0, delayBuffer, 0, 0, numSamples);
     }
     
+    if (morphActive)
+        mixMorphLayer(buffer);
+    
     // copy to second output channel -> this generates loud glitches in pro tools if mono output configuration is used
     // -> check getMainBusNumOutputChannels()
     if (buffer.getNumChannels() == 2 && getMainBusNumOutputChannels() == 2)
         buffer.copyFrom(1, 0, buffer, 0, 0, numSamples);
 }
 
+// high resolution engine: the band settings become smooth per bin alpha and gain curves
+void PolarDesignerAudioProcessor::createSpectralPatterns(AudioBuffer<float>& buffer)
+{
+    int numSamples = buffer.getNumSamples();
+    const bool adaptive = adaptiveModeActive();
+    
+    float xoverHz[4], alphas[5], gains[5];
+    for (int i = 0; i < nBands - 1; ++i)
+        xoverHz[i] = hzFromZeroToOne(i, xOverFreqs[i]->load());
+    
+    for (int i = 0; i < nBands; ++i)
+    {
+        const bool muted = (muteBand[i]->load() > 0.5 && soloBand[i]->load() < 0.5) || (soloActive && soloBand[i]->load() < 0.5);
+        const float gainDb = linkedParamsActive ? linkedParams.gains[i] : bandGains[i]->load();
+        alphas[i] = adaptive ? adaptiveAlphas[i].load() : (linkedParamsActive ? linkedParams.dirFactors[i] : dirFactors[i]->load());
+        gains[i] = muted ? 0.0f : Decibels::decibelsToGain(gainDb, -59.91f);
+        
+        // keep the filter bank ramps in sync for switching back
+        oldDirFactors[i] = alphas[i];
+        oldBandGains[i] = gainDb;
+    }
+    
+    spectralEngine.setBands(nBands, xoverHz, alphas, gains);
+    spectralEngine.process(omniEightBuffer.getReadPointer(0), omniEightBuffer.getReadPointer(1), buffer.getWritePointer(0), numSamples);
+    
+    if (buffer.getNumChannels() == 2 && getMainBusNumOutputChannels() == 2)
+        buffer.copyFrom(1, 0, buffer, 0, 0, numSamples);
+}
+
+// copy the omni and eight signal to every band and apply the band kernels
+template <int numBands>
+void PolarDesignerAudioProcessor::filterBands (int numSamples, bool applyKernels)
+{
+    for (int i = 0; i < numBands; ++i)
+    {
+        // copy input buffer for each band
+        filterBankBuffer.copyFrom (2*i, 0, omniEightBuffer, 0, 0, numSamples);
+        filterBankBuffer.copyFrom (2*i+1, 0, omniEightBuffer, 1, 0, numSamples);
+    }
+    
+    if (!applyKernels)
+        return;
+    
+    for (int i = 0; i < numBands; ++i)
+    {
+        // omni
+        float* writePointerOmni = filterBankBuffer.getWritePointer (2 * i);
+        dsp::AudioBlock<float> subBlk (&writePointerOmni, 1, numSamples);
+        dsp::ProcessContextReplacing<float> filterCtx (subBlk);
+        convolvers[2 * i].process (filterCtx); // mono processing
+        
+        // eight
+        float* writePointerEight = filterBankBuffer.getWritePointer (2 * i + 1);
+        dsp::AudioBlock<float> subBlk2 (&writePointerEight, 1, numSamples);
+        dsp::ProcessContextReplacing<float> filterCtx2 (subBlk2);
+        convolvers[2 * i + 1].process (filterCtx2); // mono processing
+    }
+}
+
+// mix omni and eight of every band to the polar pattern and add it to the first output channel
+template <int numBands>
+void PolarDesignerAudioProcessor::mixBands (AudioBuffer<float>& buffer)
+{
+    int numSamples = buffer.getNumSamples();
+    
+    const bool adaptive = adaptiveModeActive();
+    
+    for (int i = 0; i < numBands; ++i)
+    {
+        if ((muteBand[i]->load() > 0.5 && soloBand[i]->load() < 0.5) || (soloActive && soloBand[i]->load() < 0.5))
+            continue;
+        
+        if (linkedParamsActive)
+        {
+            mixLinkedBand (buffer, i);
+            continue;
+        }
+        
+        // in adaptive mode the directivity follows the internally adapted alphas instead of the parameters
+        const float dirFactor = adaptive ? adaptiveAlphas[i].load() : dirFactors[i]->load();
+        
+        // calculate patterns and add to output buffer
+        const float* readPointerOmni = filterBankBuffer.getReadPointer (2 * i);
+        const float* readPointerEight = filterBankBuffer.getReadPointer (2 * i + 1);
+        
+        float oldGain = Decibels::decibelsToGain(oldBandGains[i], -59.91f);
+        float gain = Decibels::decibelsToGain(bandGains[i]->load(), -59.91f);
+        
+        // add with ramp to prevent crackling noises
+        buffer.addFromWithRamp(0, 0, readPointerOmni, numSamples,
+                               (1 - std::abs (oldDirFactors[i])) * oldGain,
+                               (1 - std::abs (dirFactor)) * gain);
+        buffer.addFromWithRamp(0, 0, readPointerEight, numSamples,
+                               oldDirFactors[i] * oldGain,
+                               dirFactor * gain);
+        
+        oldDirFactors[i] = dirFactor;
+        oldBandGains[i] = bandGains[i]->load();
+    }
+}
+
+// mix of a band in a sync group: the coefficients follow the group's ramp on the host timeline
+void PolarDesignerAudioProcessor::mixLinkedBand (AudioBuffer<float>& buffer, int bandNr)
+{
+    const int numSamples = buffer.getNumSamples();
+    const float* readPointerOmni = filterBankBuffer.getReadPointer (2 * bandNr);
+    const float* readPointerEight = filterBankBuffer.getReadPointer (2 * bandNr + 1);
+    const ParamsToSync& p = linkedParams;
+    
+    if (blockTimelineStart < 0 || p.rampStart[bandNr] < 0)
+    {
+        // no common timeline: ramp over the block like an unlinked instance
+        float oldOmni, oldEight, omni, eight;
+        getBandCoefficients (oldDirFactors[bandNr], oldBandGains[bandNr], oldOmni, oldEight);
+        getBandCoefficients (p.dirFactors[bandNr], p.gains[bandNr], omni, eight);
+        buffer.addFromWithRamp (0, 0, readPointerOmni, numSamples, oldOmni, omni);
+        buffer.addFromWithRamp (0, 0, readPointerEight, numSamples, oldEight, eight);
+    }
+    else
+    {
+        // the coefficients are linear between the break points of the ramp, the block is split there
+        const int64 rampStart = p.rampStart[bandNr];
+        const int rampLength = getLinkedRampLength();
+        const int64 breakPoints[] = { rampStart, rampStart + rampLength };
+        
+        int pos = 0;
+        while (pos < numSamples)
+        {
+            int end = numSamples;
+            for (const int64 breakPoint : breakPoints)
+                if (breakPoint > blockTimelineStart + pos && breakPoint < blockTimelineStart + end)
+                    end = static_cast<int> (breakPoint - blockTimelineStart);
+            
+            // first and last sample of the segment, addFromWithRamp wants the value one sample after it
+            const int length = end - pos;
+            float firstOmni, firstEight, lastOmni, lastEight;
+            getLinkedCoefficients (p, bandNr, blockTimelineStart + pos, firstOmni, firstEight);
+            getLinkedCoefficients (p, bandNr, blockTimelineStart + end - 1, lastOmni, lastEight);
+            const float scale = length > 1 ? static_cast<float> (length) / (length - 1) : 0.0f;
+            
+            buffer.addFromWithRamp (0, pos, readPointerOmni + pos, length, firstOmni, firstOmni + (lastOmni - firstOmni) * scale);
+            buffer.addFromWithRamp (0, pos, readPointerEight + pos, length, firstEight, firstEight + (lastEight - firstEight) * scale);
+            pos = end;
+        }
+    }
+    
+    oldDirFactors[bandNr] = p.dirFactors[bandNr];
+    oldBandGains[bandNr] = p.gains[bandNr];
+}
+
+// host timeline position of the block, only while the transport is playing. Playback that doesn't
+// continue where the previous block ended (locate, loop, start elsewhere) is a jump.
+void PolarDesignerAudioProcessor::updateBlockTimeline (int numSamples)
+{
+    blockTimelineStart = -1;
+    if (AudioPlayHead* playHead = getPlayHead())
+        if (const auto position = playHead->getPosition())
+            if (position->getIsPlaying())
+                if (const auto timeInSamples = position->getTimeInSamples())
+                    blockTimelineStart = *timeInSamples;
+    
+    timelineJumped = blockTimelineStart >= 0 && blockTimelineStart != previousBlockTimelineEnd;
+    if (blockTimelineStart >= 0)
+        previousBlockTimelineEnd = blockTimelineStart + numSamples; // kept while stopped, resuming is no jump
+    
+    nextBlockTimelineStart = blockTimelineStart < 0 ? -1 : blockTimelineStart + numSamples;
+}
+
 void PolarDesignerAudioProcessor::setLastDir(File newLastDir)
 {
     lastDir = newLastDir;
@@ -956,438 +1720,580 @@ void PolarDesignerAudioProcessor::setLastDir(File newLastDir)
     properties->setValue ("presetFolder", v);
 }
 
-Result PolarDesignerAudioProcessor::loadPreset(const File& presetFile)
+// message thread: the preset browser opens, the library (re)scans the preset folder
+PresetLibrary& PolarDesignerAudioProcessor::getPresetLibrary()
+{
+    if (presetLibrary.getFolder() == lastDir)
+        presetLibrary.refresh();
+    else
+        presetLibrary.setFolder(lastDir);
+    return presetLibrary;
+}
+
+Result PolarDesignerAudioProcessor::loadPreset(const File& presetFile, StringArray* warnings)
 {
-    var parsedJson;
     if (!presetFile.exists())
         return Result::fail ("File does not exist!");
     
-    String jsonString = presetFile.loadFileAsString();
-    Result result = JSON::parse (jsonString, parsedJson);
+    // everything is validated before the first value is applied
+    Preset preset;
+    Result result = PresetFormat::parse (presetFile.loadFileAsString(), preset, warnings);
     if (!result.wasOk())
-        return Result::fail ("File could not be parsed: Please provide valid JSON!");
+        return result;
     
-    for (auto &it : presetProperties)
+    applyPreset (preset);
+    return Result::ok();
+}
+
+// One transaction: the host gets a single gesture over all parameters (one undo step), the filter bank is
+// built once at the end instead of for the band count and every crossover.
+void PolarDesignerAudioProcessor::applyPreset(const Preset& preset)
+{
+    Array<std::pair<RangedAudioParameter*, float>> values; // normalised
+    auto addValue = [this, &values] (const String& paramID, float denormalisedValue)
     {
-        if (!parsedJson.hasProperty (it))
-            return Result::fail ("Corrupt preset file: No '" + it + "' property found.");
-    }
-    
-    loadingFile = true;
-    
-    float x = parsedJson.getProperty ("nrActiveBands", parsedJson);
-    vtsParams.getParameter ("nrBands")->setValueNotifyingHost (vtsParams.getParameter ("nrBands")->convertTo0to1(x - 1));
-    
-    for (int i = 0; i < 4; ++i)
+        RangedAudioParameter* param = vtsParams.getParameter (paramID);
+        values.add ({param, param->convertTo0to1 (denormalisedValue)});
+    };
+    
+    // the band count goes first, the crossovers are normalised with the new band count
+    addValue ("nrBands", static_cast<float> (preset.numBands - 1));
+    const BandConfig& config = BandConfigs::get (preset.numBands);
+    for (int i = 0; i < preset.numBands - 1; ++i)
+        values.add ({vtsParams.getParameter ("xOverF" + String(i+1)), config.hzToZeroToOne (i, preset.xoverHz[i])});
+    for (int i = 0; i < 5; ++i)
     {
-        x = parsedJson.getProperty ("xOverF" + String(i+1), parsedJson);
-        vtsParams.getParameter ("xOverF" + String(i+1))->setValueNotifyingHost (hzToZeroToOne(i, x));
+        addValue ("alpha" + String(i+1), preset.dirFactors[i]);
+        addValue ("gain" + String(i+1), preset.gains[i]);
+        addValue ("solo" + String(i+1), preset.solo[i] ? 1.0f : 0.0f);
+        addValue ("mute" + String(i+1), preset.mute[i] ? 1.0f : 0.0f);
     }
+    addValue ("proximity", preset.proximity);
     
-    NormalisableRange<float> dfRange = vtsParams.getParameter("alpha1")->getNormalisableRange();
-    
-    for (int i = 0; i < 5; ++i)
     {
-        x = parsedJson.getProperty ("dirFactor" + String(i+1), parsedJson);
-        if (x < dfRange.start || x > dfRange.end)
-            return Result::fail ("DirFactor" + String(i+1) + " needs to be between " + String(dfRange.start) + " and " + String(dfRange.end) + ".");
-        vtsParams.getParameter ("alpha" + String(i+1))->setValueNotifyingHost (dfRange.convertTo0to1(x));
+        const ScopedValueSetter<bool> loading (loadingFile, true);
+        const ScopedValueSetter<bool> batch (restoringState, true);
         
-        x = parsedJson.getProperty ("gain" + String(i+1), parsedJson);
-        vtsParams.getParameter ("gain" + String(i+1))->setValueNotifyingHost (vtsParams.getParameter("gain1")->convertTo0to1(x));
+        for (auto& value : values)
+            value.first->beginChangeGesture();
         
-        x = parsedJson.getProperty ("solo" + String(i+1), parsedJson);
-        vtsParams.getParameter ("solo" + String(i+1))->setValueNotifyingHost (vtsParams.getParameter("solo1")->convertTo0to1(x));
+        for (auto& value : values)
+            value.first->setValueNotifyingHost (value.second);
         
-        x = parsedJson.getProperty ("mute" + String(i+1), parsedJson);
-        vtsParams.getParameter ("mute" + String(i+1))->setValueNotifyingHost (vtsParams.getParameter("solo1")->convertTo0to1(x));
+        for (auto& value : values)
+            value.first->endChangeGesture();
+        
+        // published to the sync group like a click on the eq buttons, the kernels follow below
+        if (doEq != preset.eqMode)
+            ffDfEqChanged = true;
+        setEqState(preset.eqMode);
+        stateDirty = true;
     }
     
-    doEq = parsedJson.getProperty ("ffDfEq", parsedJson);
-    
-    x = parsedJson.getProperty ("proximity", parsedJson);
-    vtsParams.getParameter ("proximity")->setValueNotifyingHost (vtsParams.getParameter("proximity")->convertTo0to1(x));
-    
-    loadingFile = false;
-    
     // set parameters
     nBands = static_cast<int>(nBandsPtr->load()) + 1;
     didNRActiveBandsChange = true;
-    computeAllFilterCoefficients();
     initAllConvolvers();
-    repaintDEQ = true;
-    
-    return Result::ok();
+    repaintDEQ = ALL_BANDS;
+}
+
+Preset PolarDesignerAudioProcessor::getCurrentPreset()
+{
+    Preset preset;
+    preset.numBands = nBands;
+    for (int i = 0; i < 4; ++i)
+        preset.xoverHz[i] = hzFromZeroToOne(i, xOverFreqs[i]->load());
+    for (int i = 0; i < 5; ++i)
+    {
+        preset.dirFactors[i] = dirFactors[i]->load();
+        preset.gains[i] = bandGains[i]->load();
+        preset.solo[i] = soloBand[i]->load() >= 0.5f;
+        preset.mute[i] = muteBand[i]->load() >= 0.5f;
+    }
+    preset.eqMode = doEq;
+    preset.proximity = proxDistance->load();
+    return preset;
 }
 
 Result PolarDesignerAudioProcessor::savePreset (File destination)
 {
-    DynamicObject* jsonObj = new DynamicObject();
     char versionString[10];
     strcpy(versionString, "v");
     strcat(versionString, JucePlugin_VersionString);
-    jsonObj->setProperty("Description", var("This preset file was created with the Austrian Audio PolarDesigner plugin "
-                                            + String(versionString) + ", for more information see www.austrian.audio ."));
-    jsonObj->setProperty ("nrActiveBands", nBands);
-    jsonObj->setProperty ("xOverF1", static_cast<int>(hzFromZeroToOne(0, xOverFreqs[0]->load())));
-    jsonObj->setProperty ("xOverF2", static_cast<int>(hzFromZeroToOne(1, xOverFreqs[1]->load())));
-    jsonObj->setProperty ("xOverF3", static_cast<int>(hzFromZeroToOne(2, xOverFreqs[2]->load())));
-    jsonObj->setProperty ("xOverF4", static_cast<int>(hzFromZeroToOne(3, xOverFreqs[3]->load())));
-    jsonObj->setProperty ("dirFactor1", dirFactors[0]->load());
-    jsonObj->setProperty ("dirFactor2", dirFactors[1]->load());
-    jsonObj->setProperty ("dirFactor3", dirFactors[2]->load());
-    jsonObj->setProperty ("dirFactor4", dirFactors[3]->load());
-    jsonObj->setProperty ("dirFactor5", dirFactors[4]->load());
-    jsonObj->setProperty ("gain1", bandGains[0]->load());
-    jsonObj->setProperty ("gain2", bandGains[1]->load());
-    jsonObj->setProperty ("gain3", bandGains[2]->load());
-    jsonObj->setProperty ("gain4", bandGains[3]->load());
-    jsonObj->setProperty ("gain5", bandGains[4]->load());
-    jsonObj->setProperty ("solo1", soloBand[0]->load());
-    jsonObj->setProperty ("solo2", soloBand[1]->load());
-    jsonObj->setProperty ("solo3", soloBand[2]->load());
-    jsonObj->setProperty ("solo4", soloBand[3]->load());
-    jsonObj->setProperty ("solo5", soloBand[4]->load());
-    jsonObj->setProperty ("mute1", muteBand[0]->load());
-    jsonObj->setProperty ("mute2", muteBand[1]->load());
-    jsonObj->setProperty ("mute3", muteBand[2]->load());
-    jsonObj->setProperty ("mute4", muteBand[3]->load());
-    jsonObj->setProperty ("mute5", muteBand[4]->load());
-    jsonObj->setProperty ("ffDfEq", doEq);
-    jsonObj->setProperty ("proximity", proxDistance->load());
-    
-    String jsonString = JSON::toString (var (jsonObj), false, 2);
+    const String description ("This preset file was created with the Austrian Audio PolarDesigner plugin "
+                              + String(versionString) + ", for more information see www.austrian.audio .");
+    
+    String jsonString = PresetFormat::toJson (getCurrentPreset(), description);
     if (destination.replaceWithText (jsonString))
+    {
+        if (presetLibrary.getFolder() != File() && destination.isAChildOf(presetLibrary.getFolder()))
+            presetLibrary.refresh();
         return Result::ok();
+    }
     else
         return Result::fail ("Could not write preset file. Check file access permissions.");
 }
 
 float PolarDesignerAudioProcessor::hzToZeroToOne(int idx, float hz)
 {
-    switch (nBands) {
-        case 1:
-            return 0;
-            break;
-            
-        case 2:
-            return (hz - XOVER_RANGE_START_2B[idx]) / (XOVER_RANGE_END_2B[idx] - XOVER_RANGE_START_2B[idx]);
-            break;
-            
-        case 3:
-            return (hz - XOVER_RANGE_START_3B[idx]) / (XOVER_RANGE_END_3B[idx] - XOVER_RANGE_START_3B[idx]);
-            break;
-            
-        case 4:
-            return (hz - XOVER_RANGE_START_4B[idx]) / (XOVER_RANGE_END_4B[idx] - XOVER_RANGE_START_4B[idx]);
-            break;
-            
-        case 5:
-            return (hz - XOVER_RANGE_START_5B[idx]) / (XOVER_RANGE_END_5B[idx] - XOVER_RANGE_START_5B[idx]);
-            break;
-            
-        default:
-            jassert(false);
-            break;
-    }
-    return 0;
+    if (nBands == 1)
+        return 0;
+    
+    return BandConfigs::get(nBands).hzToZeroToOne(idx, hz);
 }
 
 float PolarDesignerAudioProcessor::hzFromZeroToOne(int idx, float val)
 {
-    switch (nBands) {
-        case 1:
-            return 0;
-            break;
-            
-        case 2:
-            return XOVER_RANGE_START_2B[idx] + val * (XOVER_RANGE_END_2B[idx] - XOVER_RANGE_START_2B[idx]);
-            break;
-            
-        case 3:
-            return XOVER_RANGE_START_3B[idx] + val * (XOVER_RANGE_END_3B[idx] - XOVER_RANGE_START_3B[idx]);
-            break;
-            
-        case 4:
-            return XOVER_RANGE_START_4B[idx] + val * (XOVER_RANGE_END_4B[idx] - XOVER_RANGE_START_4B[idx]);
-            break;
-            
-        case 5:
-            return XOVER_RANGE_START_5B[idx] + val * (XOVER_RANGE_END_5B[idx] - XOVER_RANGE_START_5B[idx]);
-            break;
-            
-        default:
-            jassert(false);
-            break;
-    }
-    return 0;
+    if (nBands == 1)
+        return 0;
+    
+    return BandConfigs::get(nBands).hzFromZeroToOne(idx, val);
 }
 
 float PolarDesignerAudioProcessor::getXoverSliderRangeStart (int sliderNum)
 {
-    switch (nBands) {
-        case 2:
-            return XOVER_RANGE_START_2B[sliderNum];
-            break;
-            
-        case 3:
-            return XOVER_RANGE_START_3B[sliderNum];
-            break;
-            
-        case 4:
-            return XOVER_RANGE_START_4B[sliderNum];
-            break;
-            
-        case 5:
-            return XOVER_RANGE_START_5B[sliderNum];
-            break;
-            
-        default:
-            jassert(false);
-            break;
-    }
-    return 0;
+    jassert (nBands > 1);
+    return BandConfigs::get(nBands).xoverRangeStart[sliderNum];
 }
 
 float PolarDesignerAudioProcessor::getXoverSliderRangeEnd (int sliderNum)
 {
-    switch (nBands) {
-        case 2:
-            return XOVER_RANGE_END_2B[sliderNum];
-            break;
-            
-        case 3:
-            return XOVER_RANGE_END_3B[sliderNum];
-            break;
-            
-        case 4:
-            return XOVER_RANGE_END_4B[sliderNum];
-            break;
-            
-        case 5:
-            return XOVER_RANGE_END_5B[sliderNum];
-            break;
-            
-        default:
-            jassert(false);
-            break;
-    }
-    return 0;
+    jassert (nBands > 1);
+    return BandConfigs::get(nBands).xoverRangeEnd[sliderNum];
 }
 
-void PolarDesignerAudioProcessor::startTracking(bool trackDisturber)
+void PolarDesignerAudioProcessor::startTracking(bool trackDisturber, BandEnergyTracker::Mode windowMode, double windowSeconds)
 {
+    // the background analysis reads the statistics and cross spectra, the editor doesn't record meanwhile
+    jassert (!isAnalysing());
+    if (isAnalysing())
+        backgroundTasks.cancelAll();
+    
+    // the cross spectra are only prepared here and by the analysis, never while the other one uses them
+    trackingDisturber = trackDisturber;
+    const int64 windowLength = roundToInt64(windowSeconds * currentSampleRate);
     if (trackDisturber)
     {
-        trackingDisturber = true;
-        for (int i = 0; i < 5; ++i)
-        {
-            omniSqSumDist[i] = 0.0f;
-            eightSqSumDist[i] = 0.0f;
-            omniEightSumDist[i] = 0.0f;
-        }
+        disturberEnergy.prepare(windowMode, windowLength);
+        disturberSpectrum.prepare(currentSampleRate, *kernelStore);
+        disturberSpectrum.reset();
     }
     else
     {
-        trackingDisturber = false;
-        for (int i = 0; i < 5; ++i)
-        {
-            omniSqSumSig[i] = 0.0f;
-            eightSqSumSig[i] = 0.0f;
-            omniEightSumSig[i] = 0.0f;
-        }
+        signalEnergy.prepare(windowMode, windowLength);
+        signalSpectrum.prepare(currentSampleRate, *kernelStore);
+        signalSpectrum.reset();
+    }
+    trackedSamples = 0;
+    trackingWindowComplete = false;
+    
+    if (getKeepRecordings())
+    {
+        const File captureFolder = File::getSpecialLocation(File::tempDirectory).getChildFile("PolarDesigner");
+        captureFolder.createDirectory();
+        captureRecorder.start(captureFolder.getNonexistentChildFile(trackDisturber ? "spill" : "target", ".wav"), currentSampleRate);
     }
     
-    nrBlocksRecorded = 0;
     trackingActive = true;
 }
 
 void PolarDesignerAudioProcessor::stopTracking(int applyOptimalPattern)
 {
     trackingActive = false;
+    
+    // keep the recording for re-analysis, it replaces the previous one of its kind
+    const File capture = captureRecorder.stop();
+    if (applyOptimalPattern == 0)
+    {
+        capture.deleteFile();
+    }
+    else if (capture.existsAsFile() && captureRecorder.hasOverflowed())
+    {
+        // samples are missing, analysing it again would give other patterns than the tracking itself
+        capture.deleteFile();
+        recordingError = "The recording could not be written to disk fast enough, so it was not kept. "
+                         "The polar patterns are applied nonetheless.";
+    }
+    else if (capture.existsAsFile())
+    {
+        File& previousCapture = trackingDisturber ? disturberCapture : signalCapture;
+        previousCapture.deleteFile();
+        previousCapture = capture;
+    }
+    
     if (applyOptimalPattern == 1)
     {
-        if (trackingDisturber)
-        {
-            if (nrBlocksRecorded != 0)
-            {
-                for (int i = 0; i < 5; ++i)
-                {
-                    omniSqSumDist[i] = omniSqSumDist[i]/nrBlocksRecorded;
-                    eightSqSumDist[i] = eightSqSumDist[i]/nrBlocksRecorded;
-                    omniEightSumDist[i] = omniEightSumDist[i]/nrBlocksRecorded;
-                }
-            }
-            setMinimumDisturbancePattern();
-        }
-        else
-        {
-            if (nrBlocksRecorded != 0)
-            {
-                for (int i = 0; i < 5; ++i)
-                {
-                    omniSqSumSig[i] = omniSqSumSig[i]/nrBlocksRecorded;
-                    eightSqSumSig[i] = eightSqSumSig[i]/nrBlocksRecorded;
-                    omniEightSumSig[i] = omniEightSumSig[i]/nrBlocksRecorded;
-                }
-            }
-            setMaximumSignalPattern();
-        }
+        optimizePatterns(trackingDisturber ? SpectralPatternFit::Target::minimumDisturber
+                                           : SpectralPatternFit::Target::maximumSignal);
     }
     else if (applyOptimalPattern == 2) // max sig-to-dist
     {
         if (trackingDisturber)
-        {
-            if (nrBlocksRecorded != 0)
-            {
-                for (int i = 0; i < 5; ++i)
-                {
-                    omniSqSumDist[i] = omniSqSumDist[i]/nrBlocksRecorded;
-                    eightSqSumDist[i] = eightSqSumDist[i]/nrBlocksRecorded;
-                    omniEightSumDist[i] = omniEightSumDist[i]/nrBlocksRecorded;
-                }
-            }
             disturberRecorded = true;
-        }
         else
-        {
-            if (nrBlocksRecorded != 0)
-            {
-                for (int i = 0; i < 5; ++i)
-                {
-                    omniSqSumSig[i] = omniSqSumSig[i]/nrBlocksRecorded;
-                    eightSqSumSig[i] = eightSqSumSig[i]/nrBlocksRecorded;
-                    omniEightSumSig[i] = omniEightSumSig[i]/nrBlocksRecorded;
-                }
-            }
             signalRecorded = true;
-        }
-        maximizeSigToDistRatio();
+        
+        optimizePatterns(SpectralPatternFit::Target::maximumRatio);
     }
 }
 
-void PolarDesignerAudioProcessor::trackSignalEnergy()
+void PolarDesignerAudioProcessor::trackSignalEnergy(int numSamples, bool bandsFiltered)
 {
-    int numSamples = filterBankBuffer.getNumSamples();
-    for (int i = 0; i < nBands; ++i)
+    BandEnergyTracker& tracker = trackingDisturber ? disturberEnergy : signalEnergy;
+    tracker.addBlock (filterBankBuffer, nBands, numSamples);
+    trackedSamples += numSamples;
+    trackingWindowComplete = tracker.isWindowComplete();
+    
+    // the cross spectrum always covers the whole recording. It analyses the sum of the bands, the signal with the
+    // eq of the kernels the statistics see; unfiltered, every band holds the whole signal
+    SpectralPatternAnalyser& spectrum = trackingDisturber ? disturberSpectrum : signalSpectrum;
+    spectrum.pushBands (filterBankBuffer, bandsFiltered ? nBands : 1, numSamples);
+    
+    captureRecorder.write (omniEightBuffer.getReadPointer(0), omniEightBuffer.getReadPointer(1), numSamples);
+}
+
+// everything recorded so far, the window may only cover a part of it
+double PolarDesignerAudioProcessor::getTrackedSeconds()
+{
+    return trackedSamples.load() / currentSampleRate;
+}
+
+bool PolarDesignerAudioProcessor::isTrackingWindowComplete()
+{
+    return trackingWindowComplete.load();
+}
+
+BandEnergyTracker::Mode PolarDesignerAudioProcessor::getTrackingWindow()
+{
+    const int mode = properties->getIntValue("trackingWindow", static_cast<int>(BandEnergyTracker::Mode::accumulate));
+    return static_cast<BandEnergyTracker::Mode>(jlimit(0, 2, mode));
+}
+
+void PolarDesignerAudioProcessor::setTrackingWindow(BandEnergyTracker::Mode windowMode)
+{
+    properties->setValue("trackingWindow", static_cast<int>(windowMode));
+}
+
+bool PolarDesignerAudioProcessor::getKeepRecordings()
+{
+    return properties->getBoolValue("keepRecordings", false);
+}
+
+void PolarDesignerAudioProcessor::setKeepRecordings(bool keep)
+{
+    properties->setValue("keepRecordings", keep);
+    if (!keep)
     {
-        const float* readPointerOmni = filterBankBuffer.getReadPointer (2*i);
-        const float* readPointerEight = filterBankBuffer.getReadPointer (2*i+1);
-        if (trackingDisturber)
+        disturberCapture.deleteFile();
+        signalCapture.deleteFile();
+    }
+}
+
+bool PolarDesignerAudioProcessor::hasRecordings()
+{
+    return disturberCapture.existsAsFile() || signalCapture.existsAsFile();
+}
+
+// runs the kept recordings through the current filter bank again and applies the patterns as
+// terminating the recordings would have done; both recordings maximize the signal-to-spill ratio.
+// Kernels, filtering and optimisation are done in the background.
+bool PolarDesignerAudioProcessor::reanalyseRecordings()
+{
+    const File disturber = disturberCapture.existsAsFile() ? disturberCapture : File();
+    const File signal = signalCapture.existsAsFile() ? signalCapture : File();
+    if ((disturber == File() && signal == File()) || isAnalysing() || trackingActive)
+        return false;
+    
+    const KernelSetKey key = getKernelSetKey(ANALYSIS_BLOCK_SIZE);
+    const bool filterBands = needsKernels();
+    const EqImpulseResponseCache::ImpulseResponses::Ptr eq = eqResponses;
+    const int numBands = nBands;
+    const double sampleRate = currentSampleRate;
+    const int maxKernelLength = getMaxKernelLength();
+    const bool fitCrossovers = spectralFitActive();
+    const float alphaStart = allowBackwardsPattern->load() == 1.0f ? -0.5f : 0.0f;
+    const BandEnergyTracker::Mode windowMode = getTrackingWindow(); // the same window as the recording itself
+    const int64 windowLength = roundToInt64(TRACKING_WINDOW_SECONDS * sampleRate);
+    
+    backgroundTasks.run([this, disturber, signal, key, filterBands, eq, numBands, sampleRate, maxKernelLength, fitCrossovers, alphaStart,
+                         windowMode, windowLength]
+                        (const std::atomic<bool>& cancelled) -> std::function<void()>
+    {
+        KernelStore& store = *kernelStore;
+        const KernelSet::Ptr kernels = filterBands ? buildKernelSet(store, key, eq) : nullptr;
+        
+        StringArray errors;
+        auto analyse = [&] (const File& capture, BandEnergyTracker& energy, SpectralPatternAnalyser& spectrum)
         {
-            for (int j = 0; j < numSamples; ++j)
-            {
-                float omniSample = readPointerOmni[j];
-                omniSqSumDist[i] += omniSample * omniSample / numSamples;
-                float eightSample = readPointerEight[j];
-                eightSqSumDist[i] += eightSample * eightSample / numSamples;
-                omniEightSumDist[i] += omniSample * eightSample / numSamples;
-            }
+            if (capture == File())
+                return false;
+            
+            const Result result = analyseCapture(capture, sampleRate, numBands, kernels.get(), maxKernelLength, store, energy,
+                                                 windowMode, windowLength, spectrum, cancelled);
+            if (result.failed())
+                errors.add(result.getErrorMessage());
+            return result.wasOk();
+        };
+        const bool hasDisturber = analyse(disturber, disturberEnergy, disturberSpectrum);
+        const bool hasSignal = analyse(signal, signalEnergy, signalSpectrum);
+        if (cancelled)
+            return {};
+        
+        PatternUpdate update;
+        if (hasDisturber && hasSignal)
+        {
+            update = computePatterns(SpectralPatternFit::Target::maximumRatio, numBands, fitCrossovers, alphaStart);
+            update.disturberRecorded = update.signalRecorded = true;
         }
-        else
+        else if (hasDisturber)
         {
-            for (int j = 0; j < numSamples; ++j)
-            {
-                float omniSample = readPointerOmni[j];
-                omniSqSumSig[i] += omniSample * omniSample / numSamples;
-                float eightSample = readPointerEight[j];
-                eightSqSumSig[i] += eightSample * eightSample / numSamples;
-                omniEightSumSig[i] += omniSample * eightSample / numSamples;
-            }
+            update = computePatterns(SpectralPatternFit::Target::minimumDisturber, numBands, fitCrossovers, alphaStart);
         }
-    }
-    ++nrBlocksRecorded;
+        else if (hasSignal)
+        {
+            update = computePatterns(SpectralPatternFit::Target::maximumSignal, numBands, fitCrossovers, alphaStart);
+        }
+        
+        const String error = errors.joinIntoString("\n");
+        return [this, update, error]
+        {
+            applyPatternUpdate(update);
+            recordingError = error;
+        };
+    });
+    
+    return true;
 }
 
-void PolarDesignerAudioProcessor::setMinimumDisturbancePattern()
+// offline version of the tracking in processBlock: the capture is read memory-mapped in blocks,
+// kernels == nullptr: no filtering. Fails if the capture does not fit or as soon as the task is cancelled.
+Result PolarDesignerAudioProcessor::analyseCapture(const File& capture, double sampleRate, int numBands, const KernelSet* kernels,
+                                                 int maxKernelLength, KernelStore& store, BandEnergyTracker& energy, BandEnergyTracker::Mode windowMode,
+                                                 int64 windowLength, SpectralPatternAnalyser& spectrum, const std::atomic<bool>& cancelled)
 {
-    float disturberPower;
-    float minPowerAlpha;
-    float alphaStart = 0.0f;
-    if (allowBackwardsPattern->load() == 1.0f)
-        alphaStart = -0.5f;
+    std::unique_ptr<MemoryMappedAudioFormatReader> reader = CaptureRecorder::openCapture(capture);
+    if (reader == nullptr)
+        return Result::fail("The recording " + capture.getFileName() + " could not be read.");
     
-    for (int i = 0; i<nBands; ++i)
+    if (reader->sampleRate != sampleRate)
+        return Result::fail("The recording " + capture.getFileName() + " was made at " + String(reader->sampleRate) + " Hz, "
+                            "switch back to that sample rate to apply it again.");
+    
+    const int blockSize = ANALYSIS_BLOCK_SIZE;
+    const bool applyKernels = kernels != nullptr;
+    
+    PartitionedConvolver bandConvolvers[10];
+    dsp::ProcessSpec spec {sampleRate, static_cast<uint32>(blockSize), 1};
+    for (int i = 0; i < 2 * numBands && applyKernels; ++i)
     {
-        for (float alpha = alphaStart; alpha <= 1.0f; alpha += 0.01f)
-        {
-            float currentPower = std::pow((1-std::abs(alpha)), 2) * omniSqSumDist[i] + std::pow(alpha, 2) * eightSqSumDist[i] + 2 * (1-std::abs(alpha)) * alpha * omniEightSumDist[i];
-            if (alpha == alphaStart || currentPower < disturberPower)
-            {
-                disturberPower = currentPower;
-                minPowerAlpha = alpha;
-            }
-        }
-        if (disturberPower != 0.0f) // do not apply changes, if playback is not active
+        // a kernel set before prepare() is active from the first sample on
+        bandConvolvers[i].setKernel(kernels->getKernel(i / 2, i % 2));
+        bandConvolvers[i].prepare(spec, maxKernelLength, store);
+    }
+    
+    energy.prepare(windowMode, windowLength);
+    spectrum.prepare(sampleRate, store);
+    spectrum.reset();
+    
+    AudioBuffer<float> input (2, blockSize);
+    AudioBuffer<float> bands (2 * numBands, blockSize);
+    
+    for (int64 pos = 0; pos < reader->lengthInSamples; pos += blockSize)
+    {
+        if (cancelled)
+            return Result::fail("cancelled");
+        
+        const int numSamples = static_cast<int>(jmin<int64>(blockSize, reader->lengthInSamples - pos));
+        reader->read(&input, 0, numSamples, pos, true, true);
+        
+        for (int i = 0; i < 2 * numBands; ++i)
         {
-            vtsParams.getParameter ("alpha" + String(i+1))->setValueNotifyingHost (vtsParams.getParameter("alpha1")->convertTo0to1 (minPowerAlpha));
-            disturberRecorded = true;
+            bands.copyFrom(i, 0, input, i % 2, 0, numSamples);
+            if (!applyKernels)
+                continue;
+            
+            float* writePointer = bands.getWritePointer(i);
+            dsp::AudioBlock<float> block (&writePointer, 1, numSamples);
+            bandConvolvers[i].process(dsp::ProcessContextReplacing<float>(block));
         }
+        
+        energy.addBlock(bands, numBands, numSamples);
+        spectrum.pushBands(bands, applyKernels ? numBands : 1, numSamples); // the same signal as in trackSignalEnergy
     }
+    
+    return Result::ok();
 }
 
-void PolarDesignerAudioProcessor::setMaximumSignalPattern()
+// message thread: hands the optimisation of the recorded statistics to the background thread
+void PolarDesignerAudioProcessor::optimizePatterns(SpectralPatternFit::Target target)
 {
-    float signalPower;
-    float maxPowerAlpha;
-    float alphaStart = 0.0f;
-    if (allowBackwardsPattern->load() == 1.0f)
-        alphaStart = -0.5f;
+    const int numBands = nBands;
+    const bool fitCrossovers = spectralFitActive();
+    const float alphaStart = allowBackwardsPattern->load() == 1.0f ? -0.5f : 0.0f;
     
-    for (int i = 0; i < nBands; ++i)
+    backgroundTasks.run([this, target, numBands, fitCrossovers, alphaStart] (const std::atomic<bool>&) -> std::function<void()>
+    {
+        const PatternUpdate update = computePatterns(target, numBands, fitCrossovers, alphaStart);
+        return [this, update] { applyPatternUpdate(update); };
+    });
+}
+
+// background thread: fits crossover frequencies and alphas to the recorded cross spectra if requested,
+// otherwise (or without spectra) optimises the alpha of each band with recorded statistics
+PolarDesignerAudioProcessor::PatternUpdate PolarDesignerAudioProcessor::computePatterns(SpectralPatternFit::Target target, int numBands,
+                                                                                        bool fitCrossovers, float alphaStart)
+{
+    PatternUpdate update;
+    update.nBands = numBands;
+    
+    if (fitCrossovers)
     {
-        for (float alpha = alphaStart; alpha <= 1.0f; alpha += 0.01f)
+        const SpectralPatternFit fit = SpectralPatternFit::compute(&signalSpectrum, &disturberSpectrum, target, numBands, alphaStart, 1.0f);
+        if (fit.isValid())
         {
-            float currentPower = std::pow((1-std::abs(alpha)), 2) * omniSqSumSig[i] + std::pow(alpha, 2) * eightSqSumSig[i] + 2 * (1-std::abs(alpha)) * alpha * omniEightSumSig[i];
-            if (alpha == alphaStart || currentPower > signalPower)
+            update.hasXovers = numBands > 1;
+            for (int i = 0; i < numBands - 1; ++i)
+                update.xoverHz[i] = fit.xoverHz[i];
+            
+            for (int i = 0; i < numBands; ++i)
             {
-                signalPower = currentPower;
-                maxPowerAlpha = alpha;
+                update.hasAlpha[i] = true;
+                update.alphas[i] = fit.alphas[i];
             }
+            
+            update.disturberRecorded = target == SpectralPatternFit::Target::minimumDisturber;
+            update.signalRecorded = target == SpectralPatternFit::Target::maximumSignal;
+            return update;
         }
-        if (signalPower != 0.0f)
+    }
+    
+    for (int i = 0; i < numBands; ++i)
+    {
+        const BandStatistics sig = getSignalStatistics(i);
+        const BandStatistics dist = getDisturberStatistics(i);
+        
+        switch (target)
         {
-            vtsParams.getParameter ("alpha" + String(i+1))->setValueNotifyingHost (vtsParams.getParameter("alpha1")->convertTo0to1 (maxPowerAlpha));
-            signalRecorded = true;
+            case SpectralPatternFit::Target::minimumDisturber:
+                if (dist.isEmpty()) // do not apply changes, if playback is not active
+                    continue;
+                update.alphas[i] = PatternOptimizer::getMinimumPowerAlpha(dist, alphaStart, 1.0f);
+                update.disturberRecorded = true;
+                break;
+                
+            case SpectralPatternFit::Target::maximumSignal:
+                if (sig.isEmpty())
+                    continue;
+                update.alphas[i] = PatternOptimizer::getMaximumPowerAlpha(sig, alphaStart, 1.0f);
+                update.signalRecorded = true;
+                break;
+                
+            case SpectralPatternFit::Target::maximumRatio:
+                if (sig.isEmpty() || dist.isEmpty())
+                    continue;
+                update.alphas[i] = PatternOptimizer::getMaximumRatioAlpha(sig, dist, alphaStart, 1.0f);
+                break;
         }
+        
+        update.hasAlpha[i] = true;
     }
+    
+    return update;
 }
 
-void PolarDesignerAudioProcessor::maximizeSigToDistRatio()
+// message thread: sets all parameters of an optimisation in one go, the filter bank is rebuilt once
+// instead of once per crossover
+void PolarDesignerAudioProcessor::applyPatternUpdate(const PatternUpdate& update)
 {
-    float distToSigRatio;
-    float maxDistToSigAlpha;
-    float alphaStart = 0.0f;
-    if (allowBackwardsPattern->load() == 1.0f)
-        alphaStart = -0.5f;
+    if (update.nBands != nBands) // band count changed meanwhile, the result does not fit anymore
+        return;
+    
+    disturberRecorded = disturberRecorded || update.disturberRecorded;
+    signalRecorded = signalRecorded || update.signalRecorded;
+    
+    auto setParameter = [this] (const String& paramID, float value)
+    {
+        RangedAudioParameter* param = vtsParams.getParameter(paramID);
+        param->beginChangeGesture();
+        param->setValueNotifyingHost(value);
+        param->endChangeGesture();
+    };
     
-    for (int i = 0; i<nBands; ++i)
     {
-        for (float alpha = alphaStart; alpha <= 1.0f; alpha += 0.01f)
+        const ScopedValueSetter<bool> batch (applyingPatternUpdate, true);
+        
+        if (update.hasXovers)
         {
-            float currentSigPower = std::pow((1-std::abs(alpha)), 2) * omniSqSumSig[i] + std::pow(alpha, 2) * eightSqSumSig[i] + 2 * (1-std::abs(alpha)) * alpha * omniEightSumSig[i];
-            float currentDistPower = std::pow((1-std::abs(alpha)), 2) * omniSqSumDist[i] + std::pow(alpha, 2) * eightSqSumDist[i] + 2 * (1-std::abs(alpha)) * alpha * omniEightSumDist[i];
-            float currentRatio;
-            if (currentDistPower == 0.0f)
-                currentRatio = 0.0f;
-            else
-                currentRatio = currentSigPower/currentDistPower;
-            
-            if (alpha == alphaStart || currentRatio > distToSigRatio)
-            {
-                distToSigRatio = currentRatio;
-                maxDistToSigAlpha = alpha;
-            }
+            const BandConfig& config = BandConfigs::get(nBands);
+            for (int i = 0; i < nBands - 1; ++i)
+                setParameter("xOverF" + String(i+1), config.hzToZeroToOne(i, update.xoverHz[i]));
         }
-        if (distToSigRatio != 0.0f)
-            vtsParams.getParameter ("alpha" + String(i+1))->setValueNotifyingHost (vtsParams.getParameter("alpha1")->convertTo0to1 (maxDistToSigAlpha));
+        
+        for (int i = 0; i < nBands; ++i)
+            if (update.hasAlpha[i])
+                setParameter("alpha" + String(i+1), vtsParams.getParameter("alpha1")->convertTo0to1(update.alphas[i]));
+    }
+    
+    if (update.hasXovers)
+    {
+        initAllConvolvers();
+    }
+    repaintDEQ = ALL_BANDS;
+}
+
+// adaptive mode: exponentially weighted omni / eight statistics per band, each band's alpha is
+// steered towards the disturber power minimum with a limited rate of change
+void PolarDesignerAudioProcessor::updateAdaptivePatterns(int nActiveBands, int numSamples)
+{
+    if (resetAdaptiveStatistics.exchange(false))
+    {
+        for (auto& stats : adaptiveStatistics)
+            stats = BandStatistics();
+    }
+    
+    const float alphaStart = allowBackwardsPattern->load() >= 0.5f ? -0.5f : 0.0f;
+    const float forget = std::exp(-numSamples / (ADAPTIVE_TIME_CONSTANT * currentSampleRate));
+    const float maxStep = ADAPTIVE_MAX_ALPHA_RATE * numSamples / currentSampleRate;
+    
+    for (int i = 0; i < nActiveBands; ++i)
+    {
+        const float* readPointerOmni = filterBankBuffer.getReadPointer (2 * i);
+        const float* readPointerEight = filterBankBuffer.getReadPointer (2 * i + 1);
+        
+        const BandStatistics block = BandMoments::fromBlock (readPointerOmni, readPointerEight, numSamples).getMean (numSamples);
+        
+        BandStatistics& stats = adaptiveStatistics[i];
+        stats.omniSq = forget * stats.omniSq + (1.0f - forget) * block.omniSq;
+        stats.eightSq = forget * stats.eightSq + (1.0f - forget) * block.eightSq;
+        stats.omniEight = forget * stats.omniEight + (1.0f - forget) * block.omniEight;
+        
+        if (stats.isEmpty()) // no signal yet: keep the pattern
+            continue;
+        
+        const float target = PatternOptimizer::getMinimumPowerAlpha(stats, alphaStart, 1.0f);
+        const float alpha = adaptiveAlphas[i].load();
+        adaptiveAlphas[i] = jlimit(alphaStart, 1.0f, jlimit(alpha - maxStep, alpha + maxStep, target));
     }
 }
 
+BandStatistics PolarDesignerAudioProcessor::getSignalStatistics(int bandNr)
+{
+    return signalEnergy.getStatistics(bandNr);
+}
+
+BandStatistics PolarDesignerAudioProcessor::getDisturberStatistics(int bandNr)
+{
+    return disturberEnergy.getStatistics(bandNr);
+}
+
 void PolarDesignerAudioProcessor::setProxCompCoefficients(float distance)
+{
+    *proxCompIIR.coefficients = getProxCompCoefficients(distance, getSampleRate());
+}
+
+dsp::IIR::Coefficients<float> PolarDesignerAudioProcessor::getProxCompCoefficients(float distance, double fs)
 {
     int c = 343;
-    double fs = getSampleRate();
     
     //    float b0 = -c / (fs * 4 * distance) + 1;
     //    float b1 = -exp(-c / (fs * 2 * distance)) * (1 + c / (fs * 4 * distance));
@@ -1424,58 +2330,71 @@ void PolarDesignerAudioProcessor::setProxCompCoefficients(float distance)
         a1 = -exp(-c / fs);
     }
     
-    *proxCompIIR.coefficients = dsp::IIR::Coefficients<float>(b0,b1,a0,a1);
+    return dsp::IIR::Coefficients<float>(b0,b1,a0,a1);
 }
 
-void PolarDesignerAudioProcessor::timerCallback()
+// kernel sets or spectral engine eq requested from the audio thread, or another member of the sync group
+// published a change: apply what differs
+void PolarDesignerAudioProcessor::handleAsyncUpdate()
 {
-    if (syncChannelPtr->load() > 0.5f)
+    if (kernelSetRequested.exchange(false))
+        requestKernelSet(false);
+    if (spectralEngineEqRequested.exchange(false))
+        updateSpectralEngineEq();
+    if (otherLayerKernelSetRequested.exchange(false))
+        requestOtherLayerKernelSet();
+    
+    SyncChannel<ParamsToSync>* group = syncGroup.load();
+    if (group == nullptr)
+        return;
+    
+    ParamsToSync paramsToSync;
+    const uint32 version = group->read(paramsToSync);
+    if (version == appliedSyncVersion)
+        return;
+    appliedSyncVersion = version;
+    
+    readingSharedParams = true;
+    
+    if (nBandsPtr->load() != paramsToSync.nrActiveBands)
+        vtsParams.getParameter ("nrBands")->setValueNotifyingHost (vtsParams.getParameterRange ("nrBands").convertTo0to1 (paramsToSync.nrActiveBands));
+    
+    for (int i = 0; i < 5; ++i)
     {
-        readingSharedParams = true;
-        
-        int ch = (int) syncChannelPtr->load() - 1;
-        ParamsToSync& paramsToSync = sharedParams.get().syncParams.getReference(ch);
+        if (dirFactors[i]->load() != paramsToSync.dirFactors[i])
+            vtsParams.getParameter ("alpha" + String(i+1))->setValueNotifyingHost (vtsParams.getParameterRange ("alpha" + String(i+1)).convertTo0to1 (paramsToSync.dirFactors[i]));
         
-        if (nBandsPtr->load() != paramsToSync.nrActiveBands)
-            vtsParams.getParameter ("nrBands")->setValueNotifyingHost (vtsParams.getParameterRange ("nrBands").convertTo0to1 (paramsToSync.nrActiveBands));
-        
-        for (int i = 0; i < 5; ++i)
-        {
-            if (dirFactors[i]->load() != paramsToSync.dirFactors[i])
-                vtsParams.getParameter ("alpha" + String(i+1))->setValueNotifyingHost (vtsParams.getParameterRange ("alpha" + String(i+1)).convertTo0to1 (paramsToSync.dirFactors[i]));
-            
-            if (soloBand[i]->load() != paramsToSync.solo[i])
-                vtsParams.getParameter ("solo" + String(i+1))->setValueNotifyingHost (vtsParams.getParameterRange ("solo" + String(i+1)).convertTo0to1 (paramsToSync.solo[i]));
-            
-            if (muteBand[i]->load() != paramsToSync.mute[i])
-                vtsParams.getParameter ("mute" + String(i+1))->setValueNotifyingHost (vtsParams.getParameterRange ("mute" + String(i+1)).convertTo0to1 (paramsToSync.mute[i]));
-            
-            if (bandGains[i]->load() != paramsToSync.gains[i])
-                vtsParams.getParameter ("gain" + String(i+1))->setValueNotifyingHost (vtsParams.getParameterRange ("gain" + String(i+1)).convertTo0to1 (paramsToSync.gains[i]));
-            
-            if (i < 4 && xOverFreqs[i]->load() != paramsToSync.xOverFreqs[i])
-                vtsParams.getParameter ("xOverF" + String(i+1))->setValueNotifyingHost (vtsParams.getParameterRange ("xOverF" + String(i+1)).convertTo0to1 (paramsToSync.xOverFreqs[i]));
-            
-            
-        }
+        if (soloBand[i]->load() != paramsToSync.solo[i])
+            vtsParams.getParameter ("solo" + String(i+1))->setValueNotifyingHost (vtsParams.getParameterRange ("solo" + String(i+1)).convertTo0to1 (paramsToSync.solo[i]));
         
-        if (proxDistance->load() != paramsToSync.proximity)
-            vtsParams.getParameter ("proximity")->setValueNotifyingHost (vtsParams.getParameterRange ("proximity").convertTo0to1 (paramsToSync.proximity));
+        if (muteBand[i]->load() != paramsToSync.mute[i])
+            vtsParams.getParameter ("mute" + String(i+1))->setValueNotifyingHost (vtsParams.getParameterRange ("mute" + String(i+1)).convertTo0to1 (paramsToSync.mute[i]));
         
-        if (zeroDelayMode->load() != paramsToSync.zeroDelayMode)
-            vtsParams.getParameter ("zeroDelayMode")->setValueNotifyingHost (vtsParams.getParameterRange ("zeroDelayMode").convertTo0to1 (paramsToSync.zeroDelayMode));
+        if (bandGains[i]->load() != paramsToSync.gains[i])
+            vtsParams.getParameter ("gain" + String(i+1))->setValueNotifyingHost (vtsParams.getParameterRange ("gain" + String(i+1)).convertTo0to1 (paramsToSync.gains[i]));
         
-        if (allowBackwardsPattern->load() != paramsToSync.allowBackwardsPattern)
-            vtsParams.getParameter ("allowBackwardsPattern")->setValueNotifyingHost (vtsParams.getParameterRange ("allowBackwardsPattern").convertTo0to1 (paramsToSync.allowBackwardsPattern));
+        if (i < 4 && xOverFreqs[i]->load() != paramsToSync.xOverFreqs[i])
+            vtsParams.getParameter ("xOverF" + String(i+1))->setValueNotifyingHost (vtsParams.getParameterRange ("xOverF" + String(i+1)).convertTo0to1 (paramsToSync.xOverFreqs[i]));
         
-        if (paramsToSync.ffDfEq != doEq)
-        {
-            setEqState(paramsToSync.ffDfEq);
-            ffDfEqChanged = true;
-        }
         
-        readingSharedParams = false;
     }
+    
+    if (proxDistance->load() != paramsToSync.proximity)
+        vtsParams.getParameter ("proximity")->setValueNotifyingHost (vtsParams.getParameterRange ("proximity").convertTo0to1 (paramsToSync.proximity));
+    
+    if (zeroDelayMode->load() != paramsToSync.zeroDelayMode)
+        vtsParams.getParameter ("zeroDelayMode")->setValueNotifyingHost (vtsParams.getParameterRange ("zeroDelayMode").convertTo0to1 (paramsToSync.zeroDelayMode));
+    
+    if (allowBackwardsPattern->load() != paramsToSync.allowBackwardsPattern)
+        vtsParams.getParameter ("allowBackwardsPattern")->setValueNotifyingHost (vtsParams.getParameterRange ("allowBackwardsPattern").convertTo0to1 (paramsToSync.allowBackwardsPattern));
+    
+    if (paramsToSync.ffDfEq != doEq)
+    {
+        setEqState(paramsToSync.ffDfEq);
+        ffDfEqChanged = true;
+    }
+    
+    readingSharedParams = false;
 }
 
 void PolarDesignerAudioProcessor::updateLatency() {
@@ -1486,43 +2405,68 @@ void PolarDesignerAudioProcessor::updateLatency() {
     else
     {
         // set delay compensation to FIR_LEN/2-1 if FIR_LEN even and FIR_LEN/2 if odd
-        if (zeroDelayMode->load() < 0.5f)
-            setLatencySamples(std::ceilf(static_cast<float>(firLen) / 2 - 1));
-        else
+        if (zeroDelayMode->load() > 0.5f)
             setLatencySamples(0);
+        else if (spectralEngineActive())
+            setLatencySamples(spectralEngine.getLatency());
+        else
+            setLatencySamples(std::ceilf(static_cast<float>(firLen) / 2 - 1));
     }
 }
 
 void PolarDesignerAudioProcessor::changeAbLayerState()
 {
+    stateDirty = true;
     abLayerChanged = true;
     ffDfEqChanged = true;
-    if (abLayerState == 0)
     {
-        layerA = vtsParams.copyState();
-        doEqA = doEq;
-        if (!zeroDelayModeActive()) { oldProxDistanceA = proxDistance->load(); }
-        readingSharedParams = true;
-        
-        vtsParams.state = layerB.createCopy();
-        
-        doEq = doEqB;
-        zeroDelayModeActive() ? oldProxDistance = 0 : oldProxDistance = oldProxDistanceB;
+        // the layer's parameters don't build kernels one by one, its resident set is applied below
+        const ScopedValueSetter<bool> switching (restoringState, true);
+        const float morph = abMorph->load(); // a performance control, not part of the layers
+        if (abLayerState == 0)
+        {
+            layerA = vtsParams.copyState();
+            doEqA = doEq;
+            if (!zeroDelayModeActive()) { oldProxDistanceA = proxDistance->load(); }
+            readingSharedParams = true;
+            
+            vtsParams.state = layerB.createCopy();
+            
+            doEq = doEqB;
+            zeroDelayModeActive() ? oldProxDistance = 0 : oldProxDistance = oldProxDistanceB;
+        }
+        else
+        {
+            layerB = vtsParams.copyState();
+            doEqB = doEq;
+            if (!zeroDelayModeActive()) { oldProxDistanceB = proxDistance->load(); }
+            readingSharedParams = true;
+            
+            vtsParams.state = layerA.createCopy();
+            
+            doEq = doEqA;
+            zeroDelayModeActive() ? oldProxDistance = 0 : oldProxDistance = oldProxDistanceA;
+        }
+        vtsParams.state.setProperty("ffDfEq", var(doEq), nullptr);
+        vtsParams.getParameter ("proximity")->setValueNotifyingHost (vtsParams.getParameter("proximity")->convertTo0to1(oldProxDistance));
+        vtsParams.getParameter ("abMorph")->setValueNotifyingHost (morph);
+    }
+    
+    // Both layers keep their kernel set: switching hands the other set to the convolvers, which crossfade to it
+    // within the next partition. Only if the layer was changed meanwhile (or never had kernels) it is built.
+    const KernelSet::Ptr resident = otherLayerKernelSet;
+    setOtherLayerKernelSet(kernelSet);
+    const KernelSetKey key = getKernelSetKey(convolvers[0].getPartitionSize());
+    if (key.partitionSize > 0 && (!needsKernels() || (resident != nullptr && resident->getKey() == key)))
+    {
+        applyKernelSet(needsKernels() ? resident : nullptr, ++kernelSetSerial);
+        updateSpectralEngineEq();
     }
     else
     {
-        layerB = vtsParams.copyState();
-        doEqB = doEq;
-        if (!zeroDelayModeActive()) { oldProxDistanceB = proxDistance->load(); }
-        readingSharedParams = true;
-        
-        vtsParams.state = layerA.createCopy();
-        
-        doEq = doEqA;
-        zeroDelayModeActive() ? oldProxDistance = 0 : oldProxDistance = oldProxDistanceA;
+        initAllConvolvers();
     }
-    vtsParams.state.setProperty("ffDfEq", var(doEq), nullptr);
-    vtsParams.getParameter ("proximity")->setValueNotifyingHost (vtsParams.getParameter("proximity")->convertTo0to1(oldProxDistance));
+    updateMorphLayer();
     abLayerChanged = false;
 }
 
@@ -0,0 +1,305 @@
+/*
+ ==============================================================================
+ Main.cpp
+ PresetTool: validates, migrates and converts PolarDesigner preset folders
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#include <JuceHeader.h>
+#include <iostream>
+#include <vector>
+#include "../../../resources/BandConfig.h"
+#include "../../../resources/PresetFormat.h"
+#include "../../../resources/StateCodec.h"
+
+namespace
+{
+    struct PresetFile
+    {
+        File file;
+        File root; // the folder given on the command line, binary states keep the layout below it
+    };
+
+    struct Options
+    {
+        bool rewrite = false; // migrate: write the current format back
+        bool dryRun = false;
+        File binaryFolder;    // emit binary states if set
+    };
+
+    struct Report
+    {
+        String error;         // empty if the preset is valid
+        StringArray warnings; // values the plugin changes when it loads the preset
+        bool migrated = false;
+    };
+
+    Array<PresetFile> findPresetFiles (const ArgumentList& args)
+    {
+        Array<PresetFile> presetFiles;
+        for (int i = 1; i < args.size(); ++i) // 0 is the command
+        {
+            if (args[i].isOption())
+                continue;
+
+            const File file = args[i].resolveAsFile();
+            if (file.isDirectory())
+            {
+                Array<File> children = file.findChildFiles (File::findFiles, true, "*.json");
+                children.sort();
+                for (auto& child : children)
+                    presetFiles.add ({ child, file });
+            }
+            else if (file.existsAsFile())
+            {
+                presetFiles.add ({ file, file.getParentDirectory() });
+            }
+            else
+            {
+                ConsoleApplication::fail ("No such file or folder: " + file.getFullPathName());
+            }
+        }
+
+        if (presetFiles.isEmpty())
+            ConsoleApplication::fail ("No preset files given.");
+
+        return presetFiles;
+    }
+
+    // the values the plugin has after loading the preset, in the layout of its binary state
+    StateCodec::Layer getStateLayer (const Preset& preset)
+    {
+        StateCodec::Layer layer; // everything the preset doesn't set defaults to 0, like the plugin's parameters
+        auto setValue = [&layer] (const String& paramID, float value)
+        {
+            layer.values[StateCodec::getParameterIndex (paramID)] = value;
+        };
+
+        // crossovers the preset doesn't use keep the parameter defaults
+        const BandConfig& defaults = BandConfigs::get (BandConfigs::MAX_NUM_BANDS);
+        const BandConfig& config = BandConfigs::get (preset.numBands);
+        for (int i = 0; i < 4; ++i)
+            setValue ("xOverF" + String (i + 1), i < preset.numBands - 1
+                                                 ? jlimit (0.0f, 1.0f, config.hzToZeroToOne (i, preset.xoverHz[i]))
+                                                 : defaults.hzToZeroToOne (i, defaults.initXoverFreqs[i]));
+        for (int i = 0; i < 5; ++i)
+        {
+            setValue ("alpha" + String (i + 1), preset.dirFactors[i]);
+            setValue ("gain" + String (i + 1), preset.gains[i]);
+            setValue ("solo" + String (i + 1), preset.solo[i] ? 1.0f : 0.0f);
+            setValue ("mute" + String (i + 1), preset.mute[i] ? 1.0f : 0.0f);
+        }
+        setValue ("nrBands", static_cast<float> (preset.numBands - 1));
+        setValue ("proximity", preset.proximity);
+
+        layer.ffDfEq = preset.eqMode;
+        layer.oldProxDistance = preset.proximity;
+        return layer;
+    }
+
+    // reads a layer back like the plugin restores it: the band count first, the crossovers are normalised with it.
+    // Returns the first value that does not give back the preset (the plugin asserts the same in debug builds).
+    String checkStateLayer (const StateCodec::Layer& layer, const Preset& preset)
+    {
+        auto getValue = [&layer] (const String& paramID) { return layer.values[StateCodec::getParameterIndex (paramID)]; };
+
+        const int numBands = roundToInt (getValue ("nrBands")) + 1;
+        if (numBands != preset.numBands)
+            return "nrBands";
+
+        const BandConfig& config = BandConfigs::get (numBands);
+        for (int i = 0; i < numBands - 1; ++i)
+        {
+            const float hz = config.hzFromZeroToOne (i, getValue ("xOverF" + String (i + 1)));
+            if (std::abs (hz - preset.xoverHz[i]) > 1.0e-4f * config.getRangeWidth (i)) // the parameter's step
+                return "xOverF" + String (i + 1);
+        }
+
+        for (int i = 0; i < 5; ++i)
+        {
+            if (getValue ("alpha" + String (i + 1)) != preset.dirFactors[i])
+                return "alpha" + String (i + 1);
+            if (getValue ("gain" + String (i + 1)) != preset.gains[i])
+                return "gain" + String (i + 1);
+            if ((getValue ("solo" + String (i + 1)) >= 0.5f) != preset.solo[i])
+                return "solo" + String (i + 1);
+            if ((getValue ("mute" + String (i + 1)) >= 0.5f) != preset.mute[i])
+                return "mute" + String (i + 1);
+        }
+
+        if (getValue ("proximity") != preset.proximity)
+            return "proximity";
+        if (layer.ffDfEq != preset.eqMode)
+            return "ffDfEq";
+        return {};
+    }
+
+    Report processPreset (const PresetFile& presetFile, const Options& options)
+    {
+        Report result;
+        const String jsonString = presetFile.file.loadFileAsString();
+
+        Preset preset;
+        const Result parsed = PresetFormat::parse (jsonString, preset, &result.warnings);
+        if (parsed.failed())
+        {
+            result.error = parsed.getErrorMessage();
+            return result;
+        }
+
+        if (options.rewrite)
+        {
+            // the format savePreset() writes: all properties, values clamped to the parameter ranges
+            const String description = JSON::parse (jsonString).getProperty ("Description", String()).toString();
+            const String migrated = PresetFormat::toJson (preset, description);
+            if (migrated.replace ("\r\n", "\n") != jsonString.replace ("\r\n", "\n")) // line endings differ by platform
+            {
+                result.migrated = true;
+                if (! options.dryRun && ! presetFile.file.replaceWithText (migrated))
+                    result.error = "Could not write the file.";
+            }
+        }
+
+        if (options.binaryFolder != File() && ! options.dryRun)
+        {
+            StateCodec::State state;
+            state.layers[0] = state.layers[1] = getStateLayer (preset); // A and B both start with the preset
+
+            MemoryBlock data;
+            StateCodec::write (state, data);
+
+            // the file has to give back the preset when the plugin reads it
+            StateCodec::State restored;
+            if (! StateCodec::read (data.getData(), static_cast<int> (data.getSize()), restored))
+            {
+                result.error = "The binary state could not be read back.";
+                return result;
+            }
+            for (auto& layer : restored.layers)
+            {
+                const String mismatch = checkStateLayer (layer, preset);
+                if (mismatch.isNotEmpty())
+                {
+                    result.error = "The binary state does not restore " + mismatch + ".";
+                    return result;
+                }
+            }
+
+            const File target = options.binaryFolder.getChildFile (presetFile.file.getRelativePathFrom (presetFile.root))
+                                                    .withFileExtension ("pdstate");
+            const File folder = target.getParentDirectory();
+            if (! folder.createDirectory().wasOk() && ! folder.isDirectory()) // another job may have just created it
+                result.error = "Could not create " + folder.getFullPathName();
+            else if (! target.replaceWithData (data.getData(), data.getSize()))
+                result.error = "Could not write " + target.getFullPathName();
+        }
+
+        return result;
+    }
+
+    // all files are processed on a thread pool, the report keeps the order of the files
+    void processPresets (const ArgumentList& args, Options options)
+    {
+        if (args.containsOption ("--binary"))
+        {
+            const String folder = args.getValueForOption ("--binary");
+            if (folder.isEmpty())
+                ConsoleApplication::fail ("Missing folder: --binary=<folder>");
+            options.binaryFolder = File::getCurrentWorkingDirectory().getChildFile (folder.unquoted());
+        }
+        options.dryRun = args.containsOption ("--dry-run");
+
+        const Array<PresetFile> presetFiles = findPresetFiles (args);
+        std::vector<Report> results (static_cast<size_t> (presetFiles.size()));
+
+        {
+            ThreadPool pool (SystemStats::getNumCpus());
+            for (int i = 0; i < presetFiles.size(); ++i)
+            {
+                pool.addJob ([&presetFiles, &results, &options, i]
+                {
+                    results[static_cast<size_t> (i)] = processPreset (presetFiles.getReference (i), options);
+                });
+            }
+
+            while (pool.getNumJobs() > 0)
+                Thread::sleep (5);
+        }
+
+        int numErrors = 0, numMigrated = 0;
+        for (int i = 0; i < presetFiles.size(); ++i)
+        {
+            const Report& result = results[static_cast<size_t> (i)];
+            const String path = presetFiles.getReference (i).file.getFullPathName();
+            if (result.error.isNotEmpty())
+            {
+                ++numErrors;
+                std::cout << "error     " << path << ": " << result.error << std::endl;
+            }
+            else if (result.migrated)
+            {
+                ++numMigrated;
+                std::cout << (options.dryRun ? "outdated  " : "migrated  ") << path << std::endl;
+            }
+            else
+            {
+                std::cout << "ok        " << path << std::endl;
+            }
+
+            for (auto& warning : result.warnings)
+                std::cout << "warning   " << path << ": " << warning << std::endl;
+        }
+
+        std::cout << presetFiles.size() << " presets, " << numErrors << " errors";
+        if (options.rewrite)
+            std::cout << ", " << numMigrated << (options.dryRun ? " to migrate" : " migrated");
+        std::cout << std::endl;
+
+        if (numErrors > 0)
+            ConsoleApplication::fail (String (numErrors) + " of " + String (presetFiles.size()) + " presets failed.");
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    ConsoleApplication app;
+    app.addHelpCommand ("--help|-h", "PresetTool: validates, migrates and converts PolarDesigner presets.\n"
+                                     "Folders are searched recursively for .json files.", true);
+
+    app.addCommand ({ "validate",
+                      "validate <files or folders> [--binary=<folder>]",
+                      "Checks every preset, the exit code is 1 if any of them is broken.",
+                      "With --binary the plugin state of each valid preset is written to <folder> (.pdstate).",
+                      [] (const ArgumentList& args) { processPresets (args, {}); } });
+
+    app.addCommand ({ "migrate",
+                      "migrate <files or folders> [--dry-run] [--binary=<folder>]",
+                      "Rewrites valid presets in the current format.",
+                      "All properties are written and values are clamped to the parameter ranges.\n"
+                      "--dry-run only lists the presets that would change.",
+                      [] (const ArgumentList& args)
+                      {
+                          Options options;
+                          options.rewrite = true;
+                          processPresets (args, options);
+                      } });
+
+    return app.findAndRunCommand (argc, argv);
+}
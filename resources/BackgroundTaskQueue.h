@@ -0,0 +1,147 @@
+/*
+ ==============================================================================
+ BackgroundTaskQueue.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// Worker threads shared by all plugin instances (use via SharedResourcePointer) for work that would
+// otherwise stall the message thread. Each lane has one thread, the tasks of all instances in a lane run one
+// after another; kernel builds have their own lane, so they never wait behind a long analysis.
+class BackgroundTaskQueue
+{
+public:
+    // Runs on the worker thread and returns the completion, which is called on the message thread.
+    // cancelled is set when the client cancels: long tasks check it regularly and return early.
+    using Task = std::function<std::function<void()> (const std::atomic<bool>& cancelled)>;
+
+    enum class Lane
+    {
+        analysis, // analysis, optimisation, preset scans
+        kernels   // kernel sets the audio is waiting for
+    };
+
+    BackgroundTaskQueue() : analysisPool (1), kernelPool (1) {}
+    ~BackgroundTaskQueue()
+    {
+        analysisPool.removeAllJobs (true, -1);
+        kernelPool.removeAllJobs (true, -1);
+    }
+
+    // Per instance handle, message thread only. Destroying it (or cancelAll) removes the pending tasks of
+    // the instance, cancels a running one and waits until it has returned, and drops completions that have
+    // not been delivered yet. Tasks may therefore use their owner until they return.
+    class Client
+    {
+    public:
+        explicit Client (Lane taskLane = Lane::analysis) : lane (taskLane) {}
+        ~Client() { cancelAll(); }
+
+        void run (Task task)
+        {
+            ++numPending;
+            auto taskCancelled = cancelled;
+            queue->addJob (lane, this, [this, taskCancelled, task = std::move (task)]
+            {
+                if (*taskCancelled)
+                    return;
+
+                auto completion = task (*taskCancelled);
+                MessageManager::callAsync ([this, taskCancelled, completion = std::move (completion)]
+                {
+                    if (*taskCancelled)
+                        return;
+
+                    if (completion)
+                        completion();
+                    --numPending;
+                });
+            });
+        }
+
+        void cancelAll()
+        {
+            *cancelled = true;
+            queue->removeJobs (lane, this);
+            cancelled = std::make_shared<std::atomic<bool>> (false);
+            numPending = 0;
+        }
+
+        // true until the completions of all tasks have been called
+        bool isBusy() const { return numPending > 0; }
+
+    private:
+        SharedResourcePointer<BackgroundTaskQueue> queue;
+        const Lane lane;
+        std::shared_ptr<std::atomic<bool>> cancelled = std::make_shared<std::atomic<bool>> (false);
+        int numPending = 0;
+
+        JUCE_DECLARE_NON_COPYABLE (Client)
+    };
+
+private:
+    class Job : public ThreadPoolJob
+    {
+    public:
+        Job (const void* jobOwner, std::function<void()> jobWork)
+            : ThreadPoolJob ("PolarDesigner background task"), owner (jobOwner), work (std::move (jobWork)) {}
+
+        JobStatus runJob() override
+        {
+            work();
+            return jobHasFinished;
+        }
+
+        const void* const owner;
+
+    private:
+        std::function<void()> work;
+    };
+
+    struct OwnerSelector : public ThreadPool::JobSelector
+    {
+        explicit OwnerSelector (const void* o) : owner (o) {}
+        bool isJobSuitable (ThreadPoolJob* job) override { return static_cast<Job*> (job)->owner == owner; }
+        const void* owner;
+    };
+
+    ThreadPool& getPool (Lane lane) { return lane == Lane::kernels ? kernelPool : analysisPool; }
+
+    void addJob (Lane lane, const void* owner, std::function<void()> work)
+    {
+        getPool (lane).addJob (new Job (owner, std::move (work)), true);
+    }
+
+    void removeJobs (Lane lane, const void* owner)
+    {
+        // no timeout: a running job may use its owner until it returns, it stops early once it sees its flag
+        OwnerSelector selector (owner);
+        getPool (lane).removeAllJobs (true, -1, &selector);
+    }
+
+    ThreadPool analysisPool, kernelPool;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BackgroundTaskQueue)
+};
@@ -0,0 +1,66 @@
+/*
+ ==============================================================================
+ BandConfig.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+
+// crossover configuration for one number of bands (nBands - 1 crossovers are used)
+struct BandConfig
+{
+    float initXoverFreqs[4];
+    float xoverRangeStart[4];
+    float xoverRangeEnd[4];
+
+    constexpr float getRangeWidth (int idx) const { return xoverRangeEnd[idx] - xoverRangeStart[idx]; }
+    constexpr float hzToZeroToOne (int idx, float hz) const { return (hz - xoverRangeStart[idx]) / getRangeWidth (idx); }
+    constexpr float hzFromZeroToOne (int idx, float val) const { return xoverRangeStart[idx] + val * getRangeWidth (idx); }
+};
+
+struct BandConfigs
+{
+    static constexpr int MAX_NUM_BANDS = 5;
+
+    // indexed by nBands - 1, one band has no crossovers
+    static constexpr BandConfig table[MAX_NUM_BANDS] =
+    {
+        { {}, {}, {} },
+        { {1000.0f}, {120.0f}, {12000.0f} },
+        { {250.0f, 3000.0f}, {120.0f, 2000.0f}, {1000.0f, 12000.0f} },
+        { {200.0f, 1000.0f, 5000.0f}, {120.0f, 900.0f, 4000.0f}, {450.0f, 2500.0f, 12000.0f} },
+        { {150.0f, 600.0f, 2600.0f, 8000.0f}, {120.0f, 500.0f, 2200.0f, 7000.0f}, {200.0f, 1100.0f, 4000.0f, 12000.0f} }
+    };
+
+    static constexpr const BandConfig& get (int nBands) { return table[nBands - 1]; }
+};
+
+// every used crossover range must be valid
+static_assert (BandConfigs::get (2).getRangeWidth (0) > 0.0f, "invalid crossover range");
+static_assert (BandConfigs::get (3).getRangeWidth (1) > 0.0f, "invalid crossover range");
+static_assert (BandConfigs::get (4).getRangeWidth (2) > 0.0f, "invalid crossover range");
+static_assert (BandConfigs::get (5).getRangeWidth (3) > 0.0f, "invalid crossover range");
+static_assert (BandConfigs::get (5).hzToZeroToOne (0, 120.0f) == 0.0f, "crossover mapping");
+// crossovers within their ranges are in ascending order, presets rely on it
+static_assert (BandConfigs::get (3).xoverRangeEnd[0] <= BandConfigs::get (3).xoverRangeStart[1], "overlapping crossover ranges");
+static_assert (BandConfigs::get (4).xoverRangeEnd[0] <= BandConfigs::get (4).xoverRangeStart[1], "overlapping crossover ranges");
+static_assert (BandConfigs::get (4).xoverRangeEnd[1] <= BandConfigs::get (4).xoverRangeStart[2], "overlapping crossover ranges");
+static_assert (BandConfigs::get (5).xoverRangeEnd[0] <= BandConfigs::get (5).xoverRangeStart[1], "overlapping crossover ranges");
+static_assert (BandConfigs::get (5).xoverRangeEnd[1] <= BandConfigs::get (5).xoverRangeStart[2], "overlapping crossover ranges");
+static_assert (BandConfigs::get (5).xoverRangeEnd[2] <= BandConfigs::get (5).xoverRangeStart[3], "overlapping crossover ranges");
@@ -0,0 +1,215 @@
+/*
+ ==============================================================================
+ BandEnergyTracker.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "PatternOptimizer.h"
+
+// omni^2, eight^2 and omni * eight sums of one band
+struct BandMoments
+{
+    double omniSq = 0.0;
+    double eightSq = 0.0;
+    double omniEight = 0.0;
+
+    BandMoments& operator+= (const BandMoments& other)
+    {
+        omniSq += other.omniSq;
+        eightSq += other.eightSq;
+        omniEight += other.omniEight;
+        return *this;
+    }
+
+    static BandMoments fromStatistics (const BandStatistics& s) { return { s.omniSq, s.eightSq, s.omniEight }; }
+
+    static BandMoments difference (const BandMoments& a, const BandMoments& b)
+    {
+        return { a.omniSq - b.omniSq, a.eightSq - b.eightSq, a.omniEight - b.omniEight };
+    }
+
+    BandStatistics getMean (double divisor) const
+    {
+        if (divisor <= 0.0)
+            return {};
+
+        return { static_cast<float> (omniSq / divisor), static_cast<float> (eightSq / divisor),
+                 static_cast<float> (omniEight / divisor) };
+    }
+
+    // One pass over a block. Independent float lanes keep the loop free of dependencies so the
+    // compiler can vectorise it; the lanes are short enough for float and are combined in double.
+    static BandMoments fromBlock (const float* omni, const float* eight, int numSamples)
+    {
+        constexpr int numLanes = 8;
+        float oo[numLanes] = {}, ee[numLanes] = {}, oe[numLanes] = {};
+
+        int i = 0;
+        for (; i + numLanes <= numSamples; i += numLanes)
+        {
+            for (int lane = 0; lane < numLanes; ++lane)
+            {
+                const float o = omni[i + lane];
+                const float e = eight[i + lane];
+                oo[lane] += o * o;
+                ee[lane] += e * e;
+                oe[lane] += o * e;
+            }
+        }
+
+        BandMoments moments;
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            moments.omniSq += oo[lane];
+            moments.eightSq += ee[lane];
+            moments.omniEight += oe[lane];
+        }
+
+        for (; i < numSamples; ++i)
+        {
+            const double o = omni[i];
+            const double e = eight[i];
+            moments.omniSq += o * o;
+            moments.eightSq += e * e;
+            moments.omniEight += o * e;
+        }
+
+        return moments;
+    }
+};
+
+// Streaming band moment statistics of the filter bank output. Every sample weighs the same, no matter
+// how the host splits the audio into blocks, so a capture gives the same result in every host.
+// Sums are kept in double, so long recordings do not lose precision.
+class BandEnergyTracker
+{
+public:
+    enum class Mode
+    {
+        accumulate,  // everything since reset()
+        fixedLength, // the first windowLength samples, later samples are ignored
+        sliding      // the most recent windowLength samples (rounded up to whole chunks)
+    };
+
+    BandEnergyTracker() {}
+    ~BandEnergyTracker() {}
+
+    // message thread, no blocks may be added meanwhile (allocates the ring buffer of the sliding window)
+    void prepare (Mode newMode, int64 newWindowLength = 0, int newChunkLength = 256)
+    {
+        mode = newWindowLength > 0 ? newMode : Mode::accumulate;
+        windowLength = newWindowLength;
+        chunkLength = jmax (1, newChunkLength);
+
+        chunks.clear();
+        if (mode == Mode::sliding)
+            chunks.resize (static_cast<int> ((windowLength + chunkLength - 1) / chunkLength) + 1);
+
+        reset();
+    }
+
+    void reset()
+    {
+        total = Chunk();
+        for (auto& chunk : chunks)
+            chunk = Chunk();
+        currentChunk = 0;
+    }
+
+    // filterBank holds omni / eight of band i in channels 2 * i and 2 * i + 1, numSamples is the
+    // number of valid samples in this block
+    void addBlock (const AudioBuffer<float>& filterBank, int nBands, int numSamples)
+    {
+        int pos = 0;
+        while (pos < numSamples)
+        {
+            int numToAdd = numSamples - pos;
+            if (mode == Mode::fixedLength)
+                numToAdd = static_cast<int> (jmin<int64> (numToAdd, windowLength - total.numSamples));
+            else if (mode == Mode::sliding)
+                numToAdd = jmin (numToAdd, chunkLength - static_cast<int> (chunks.getReference (currentChunk).numSamples));
+
+            if (numToAdd <= 0)
+                return; // fixed window complete
+
+            // the ring advances at absolute sample positions, independent of the block size
+            Chunk& target = (mode == Mode::sliding) ? chunks.getReference (currentChunk) : total;
+            for (int i = 0; i < nBands; ++i)
+                target.bands[i] += BandMoments::fromBlock (filterBank.getReadPointer (2 * i, pos),
+                                                           filterBank.getReadPointer (2 * i + 1, pos), numToAdd);
+            target.numSamples += numToAdd;
+            pos += numToAdd;
+
+            if (mode == Mode::sliding && target.numSamples == chunkLength)
+            {
+                currentChunk = (currentChunk + 1) % chunks.size();
+                chunks.getReference (currentChunk) = Chunk(); // drop the oldest chunk
+            }
+        }
+    }
+
+    // mean over all samples in the window
+    BandStatistics getStatistics (int bandNr) const
+    {
+        if (mode != Mode::sliding)
+            return total.bands[bandNr].getMean (static_cast<double> (total.numSamples));
+
+        BandMoments sum;
+        int64 numSamples = 0;
+        for (auto& chunk : chunks)
+        {
+            sum += chunk.bands[bandNr];
+            numSamples += chunk.numSamples;
+        }
+        return sum.getMean (static_cast<double> (numSamples));
+    }
+
+    int64 getNumSamples() const
+    {
+        if (mode != Mode::sliding)
+            return total.numSamples;
+
+        int64 numSamples = 0;
+        for (auto& chunk : chunks)
+            numSamples += chunk.numSamples;
+        return numSamples;
+    }
+
+    bool isWindowComplete() const { return mode == Mode::fixedLength && total.numSamples >= windowLength; }
+
+private:
+    struct Chunk
+    {
+        BandMoments bands[5];
+        int64 numSamples = 0;
+    };
+
+    Mode mode = Mode::accumulate;
+    int64 windowLength = 0;
+    int chunkLength = 256;
+
+    Chunk total;         // accumulate and fixedLength
+    Array<Chunk> chunks; // ring buffer of the sliding window, the last one is still being filled
+    int currentChunk = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BandEnergyTracker)
+};
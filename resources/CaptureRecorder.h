@@ -0,0 +1,119 @@
+/*
+ ==============================================================================
+ CaptureRecorder.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+// Streams the omni and eight signal of a recording into a two channel float wav file, so it can be
+// analysed again later (other band count, other optimiser). The audio thread only pushes into the lock-free
+// fifo of a ThreadedWriter, the disk is written by a background thread.
+class CaptureRecorder
+{
+public:
+    static constexpr int FIFO_SIZE = 1 << 16; // samples per channel, about 1.4 s at 48 kHz
+
+    CaptureRecorder() : writerThread ("PolarDesigner capture") {}
+
+    ~CaptureRecorder()
+    {
+        stop();
+        writerThread.stopThread (1000);
+    }
+
+    // message thread
+    bool start (const File& destination, double sampleRate)
+    {
+        stop();
+
+        destination.deleteFile();
+        std::unique_ptr<FileOutputStream> stream (destination.createOutputStream());
+        if (stream == nullptr)
+            return false;
+
+        WavAudioFormat wavFormat;
+        std::unique_ptr<AudioFormatWriter> writer (wavFormat.createWriterFor (stream.get(), sampleRate, 2, 32, {}, 0));
+        if (writer == nullptr)
+            return false;
+        stream.release(); // owned by the writer now
+
+        if (! writerThread.isThreadRunning())
+            writerThread.startThread();
+
+        threadedWriter.reset (new AudioFormatWriter::ThreadedWriter (writer.release(), writerThread, FIFO_SIZE));
+        file = destination;
+        overflowed = false;
+
+        const SpinLock::ScopedLockType sl (writerLock);
+        activeWriter = threadedWriter.get();
+        return true;
+    }
+
+    // audio thread: never blocks, samples are dropped if the disk falls behind
+    void write (const float* omni, const float* eight, int numSamples)
+    {
+        const SpinLock::ScopedTryLockType tl (writerLock);
+        if (! tl.isLocked() || activeWriter == nullptr)
+            return;
+
+        const float* channels[] = { omni, eight };
+        if (! activeWriter->write (channels, numSamples))
+            overflowed = true;
+    }
+
+    // message thread: flushes and closes the file, returns it (or File() if nothing was recorded)
+    File stop()
+    {
+        {
+            const SpinLock::ScopedLockType sl (writerLock);
+            activeWriter = nullptr;
+        }
+        threadedWriter.reset();
+
+        return std::exchange (file, File());
+    }
+
+    // true if samples were dropped during the last recording
+    bool hasOverflowed() const { return overflowed; }
+
+    // the file stays mapped as long as the reader exists
+    static std::unique_ptr<MemoryMappedAudioFormatReader> openCapture (const File& capture)
+    {
+        WavAudioFormat wavFormat;
+        std::unique_ptr<MemoryMappedAudioFormatReader> reader (wavFormat.createMemoryMappedReader (capture));
+        if (reader == nullptr || reader->numChannels != 2 || ! reader->mapEntireFile())
+            return nullptr;
+
+        return reader;
+    }
+
+private:
+    TimeSliceThread writerThread;
+    std::unique_ptr<AudioFormatWriter::ThreadedWriter> threadedWriter;
+    File file;
+
+    SpinLock writerLock;
+    AudioFormatWriter::ThreadedWriter* activeWriter = nullptr;
+    std::atomic<bool> overflowed { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CaptureRecorder)
+};
@@ -0,0 +1,124 @@
+/*
+ ==============================================================================
+ EqImpulseResponseCache.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "EqCoefficients.h"
+
+// Free field / diffuse field eq responses resampled to a given sample rate.
+// The 48 kHz tables are resampled once per sample rate and then shared by all
+// plugin instances (use via SharedResourcePointer).
+class EqImpulseResponseCache
+{
+public:
+    enum EqType
+    {
+        freeField = 0,
+        diffuseField
+    };
+
+    static const int EQ_LEN = 512;
+    static const int EQ_SAMPLE_RATE = 48000;
+
+    // immutable set of the four eq responses at one sample rate
+    class ImpulseResponses : public ReferenceCountedObject
+    {
+    public:
+        using Ptr = ReferenceCountedObjectPtr<ImpulseResponses>;
+
+        ImpulseResponses (double newSampleRate) : sampleRate (newSampleRate)
+        {
+            resample (FFEQ_COEFFS_OMNI, irs[0]);
+            resample (FFEQ_COEFFS_EIGHT, irs[1]);
+            resample (DFEQ_COEFFS_OMNI, irs[2]);
+            resample (DFEQ_COEFFS_EIGHT, irs[3]);
+        }
+
+        const AudioBuffer<float>& getOmni (EqType type) const { return irs[2 * type]; }
+        const AudioBuffer<float>& getEight (EqType type) const { return irs[2 * type + 1]; }
+        double getSampleRate() const { return sampleRate; }
+        int getMaxLength() const
+        {
+            int maxLength = 0;
+            for (auto& ir : irs)
+                maxLength = jmax (maxLength, ir.getNumSamples());
+            return maxLength;
+        }
+
+    private:
+        // resample a 48 kHz eq response (the same way dsp::Convolution would do it)
+        void resample (const float* coeffs, AudioBuffer<float>& dest)
+        {
+            AudioBuffer<float> source (1, EQ_LEN);
+            source.copyFrom (0, 0, coeffs, EQ_LEN);
+
+            if (sampleRate == EQ_SAMPLE_RATE)
+            {
+                dest.makeCopyOf (source);
+                return;
+            }
+
+            const double ratio = EQ_SAMPLE_RATE / sampleRate;
+            const int resampledLen = roundToInt (jmax (1.0, EQ_LEN / ratio));
+
+            MemoryAudioSource memorySource (source, false);
+            ResamplingAudioSource resamplingSource (&memorySource, false, 1);
+            resamplingSource.setResamplingRatio (ratio);
+            resamplingSource.prepareToPlay (resampledLen, EQ_SAMPLE_RATE);
+
+            dest.setSize (1, resampledLen);
+            resamplingSource.getNextAudioBlock ({ &dest, 0, resampledLen });
+
+            // keep the magnitude response independent of the sample rate
+            dest.applyGain (static_cast<float> (ratio));
+        }
+
+        const double sampleRate;
+        AudioBuffer<float> irs[4]; // ff omni, ff eight, df omni, df eight
+
+        JUCE_DECLARE_NON_COPYABLE (ImpulseResponses)
+    };
+
+    EqImpulseResponseCache() {}
+    ~EqImpulseResponseCache() {}
+
+    // thread safe, only resamples if this sample rate has not been requested before
+    ImpulseResponses::Ptr getForSampleRate (double sampleRate)
+    {
+        const ScopedLock sl (lock);
+
+        for (auto& set : cachedSets)
+            if (set->getSampleRate() == sampleRate)
+                return set;
+
+        ImpulseResponses::Ptr newSet (new ImpulseResponses (sampleRate));
+        cachedSets.add (newSet);
+        return newSet;
+    }
+
+private:
+    CriticalSection lock;
+    Array<ImpulseResponses::Ptr> cachedSets; // only a handful of sample rates, kept for the lifetime of the cache
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (EqImpulseResponseCache)
+};
@@ -0,0 +1,286 @@
+/*
+ ==============================================================================
+ KernelStore.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <functional>
+
+// everything a band kernel depends on: two plugin instances with equal keys can share the kernel
+struct KernelKey
+{
+    double sampleRate = 0.0;
+    int partitionSize = 0; // convolution block size the spectra are partitioned for
+    int firLen = 0;
+    float lowHz = 0.0f;    // lower band edge, 0 = lowpass (or no filter)
+    float highHz = 0.0f;   // upper band edge, 0 = highpass (or no filter)
+    int eqMode = 0;        // 0 = no eq, 1 = free field, 2 = diffuse field
+    int eqChannel = 0;     // 0 = omni, 1 = eight (only differs if eqMode != 0)
+
+    bool operator== (const KernelKey& other) const
+    {
+        return sampleRate == other.sampleRate && partitionSize == other.partitionSize
+            && firLen == other.firLen && lowHz == other.lowHz && highHz == other.highHz
+            && eqMode == other.eqMode && eqChannel == other.eqChannel;
+    }
+    bool operator!= (const KernelKey& other) const { return ! operator== (other); }
+};
+
+// complete filter bank setting: instances with equal keys (e.g. linked by a sync group) share one kernel set
+struct KernelSetKey
+{
+    double sampleRate = 0.0;
+    int partitionSize = 0;
+    int firLen = 0;
+    int nBands = 0;
+    float xoverHz[4] = {};
+    int eqMode = 0;
+
+    bool operator== (const KernelSetKey& other) const
+    {
+        if (sampleRate != other.sampleRate || partitionSize != other.partitionSize || firLen != other.firLen
+            || nBands != other.nBands || eqMode != other.eqMode)
+            return false;
+
+        for (int i = 0; i < nBands - 1; ++i)
+            if (xoverHz[i] != other.xoverHz[i])
+                return false;
+
+        return true;
+    }
+    bool operator!= (const KernelSetKey& other) const { return ! operator== (other); }
+
+    KernelKey getBandKey (int bandNr, int ch) const
+    {
+        KernelKey key;
+        key.sampleRate = sampleRate;
+        key.partitionSize = partitionSize;
+        key.firLen = firLen;
+        key.lowHz = bandNr > 0 ? xoverHz[bandNr - 1] : 0.0f;
+        key.highHz = bandNr < nBands - 1 ? xoverHz[bandNr] : 0.0f;
+        key.eqMode = eqMode;
+        key.eqChannel = eqMode != 0 ? ch : 0; // without eq omni and eight share the kernel
+        return key;
+    }
+};
+
+// Immutable filter bank kernel: the impulse response of one band (filter and eq combined),
+// already transformed into the partitioned spectra the PartitionedConvolver multiplies with.
+// Instances never modify a kernel, a changed setting always results in a different kernel.
+class BandKernel : public ReferenceCountedObject
+{
+public:
+    using Ptr = ReferenceCountedObjectPtr<BandKernel>;
+
+    BandKernel (const KernelKey& newKey, const AudioBuffer<float>& impulseResponse, const dsp::FFT& fft)
+        : key (newKey), irLength (impulseResponse.getNumSamples())
+    {
+        const int fftSize = fft.getSize();
+        const int segmentLen = getSegmentLength (fftSize, key.partitionSize);
+        const int numSegments = getNumSegments (irLength, fftSize, key.partitionSize);
+
+        segments.setSize (numSegments, 2 * fftSize);
+        segments.clear();
+
+        const float* ir = impulseResponse.getReadPointer (0);
+        for (int i = 0; i < numSegments; ++i)
+        {
+            float* segment = segments.getWritePointer (i);
+            const int numToCopy = jmin (segmentLen, irLength - i * segmentLen);
+            if (numToCopy > 0)
+                FloatVectorOperations::copy (segment, ir + i * segmentLen, numToCopy);
+
+            fft.performRealOnlyForwardTransform (segment);
+            prepareForConvolution (segment, fftSize);
+        }
+    }
+
+    const KernelKey& getKey() const { return key; }
+    int getLength() const { return irLength; }
+    int getNumSegments() const { return segments.getNumChannels(); }
+    const float* getSegment (int idx) const { return segments.getReadPointer (idx); }
+
+    // fft size used for a given partition size (same choice as juce::dsp::Convolution)
+    static int getFftSize (int partitionSize) { return partitionSize > 128 ? 2 * partitionSize : 4 * partitionSize; }
+    static int getSegmentLength (int fftSize, int partitionSize) { return fftSize - partitionSize; }
+    static int getNumSegments (int irLength, int fftSize, int partitionSize)
+    {
+        return irLength / getSegmentLength (fftSize, partitionSize) + 1;
+    }
+
+    // rearranges the output of performRealOnlyForwardTransform into split real / imaginary parts:
+    // re[0..fftSize/2-1], im[0..fftSize/2-1], nyquist bin at index fftSize
+    static void prepareForConvolution (float* samples, int fftSize) noexcept
+    {
+        const int halfSize = fftSize / 2;
+
+        for (int i = 0; i < halfSize; ++i)
+            samples[i] = samples[i << 1];
+
+        samples[halfSize] = 0.0f;
+
+        for (int i = 1; i < halfSize; ++i)
+            samples[i + halfSize] = -samples[((fftSize - i) << 1) + 1];
+    }
+
+private:
+    const KernelKey key;
+    const int irLength;
+    AudioBuffer<float> segments; // one channel per partition, each holding a split spectrum
+
+    JUCE_DECLARE_NON_COPYABLE (BandKernel)
+};
+
+// omni and eight kernels of all bands of one filter bank setting
+class KernelSet : public ReferenceCountedObject
+{
+public:
+    using Ptr = ReferenceCountedObjectPtr<KernelSet>;
+
+    explicit KernelSet (const KernelSetKey& newKey) : key (newKey) {}
+
+    const KernelSetKey& getKey() const { return key; }
+    BandKernel::Ptr getKernel (int bandNr, int ch) const { return kernels[2 * bandNr + ch]; }
+
+private:
+    friend class KernelStore;
+
+    const KernelSetKey key;
+    BandKernel::Ptr kernels[10];
+
+    JUCE_DECLARE_NON_COPYABLE (KernelSet)
+};
+
+// Kernels and fft objects shared by all plugin instances (use via SharedResourcePointer).
+// Memory scales with the number of distinct settings instead of the number of instances.
+class KernelStore
+{
+public:
+    KernelStore() {}
+    ~KernelStore() {}
+
+    // Returns the kernel for this key, designImpulseResponse is only called if no instance has built it yet.
+    // Call from the message thread or a background thread, never from the audio thread. The store keeps a
+    // reference to every kernel it hands out, so dropping a kernel on the audio thread never frees memory
+    // there; unused kernels are released here. Design and transform run without the lock, so other threads
+    // can look up kernels meanwhile; if two threads build the same kernel, the first one is kept.
+    BandKernel::Ptr getKernel (const KernelKey& key, const std::function<void (AudioBuffer<float>&)>& designImpulseResponse)
+    {
+        if (auto existing = findKernel (key))
+            return existing;
+
+        AudioBuffer<float> impulseResponse;
+        designImpulseResponse (impulseResponse);
+        BandKernel::Ptr newKernel (new BandKernel (key, impulseResponse, getFft (BandKernel::getFftSize (key.partitionSize))));
+
+        const ScopedLock sl (lock);
+        for (auto& kernel : kernels) // built by another thread meanwhile
+            if (kernel->getKey() == key)
+                return kernel;
+
+        kernels.add (newKernel);
+        return newKernel;
+    }
+
+    // Returns the kernel set for this key. Only bands no instance has built yet are designed, so moving one
+    // crossover costs two bands, and linked instances requesting the same setting get the same set.
+    using DesignBandFunction = std::function<void (int bandNr, int ch, AudioBuffer<float>&)>;
+    KernelSet::Ptr getKernelSet (const KernelSetKey& key, const DesignBandFunction& designImpulseResponse)
+    {
+        if (auto existing = findKernelSet (key))
+            return existing;
+
+        // built without holding the lock, the bands are looked up one by one
+        KernelSet::Ptr newSet (new KernelSet (key));
+        for (int bandNr = 0; bandNr < key.nBands; ++bandNr)
+            for (int ch = 0; ch < 2; ++ch)
+                newSet->kernels[2 * bandNr + ch] = getKernel (key.getBandKey (bandNr, ch), [&] (AudioBuffer<float>& ir)
+                {
+                    designImpulseResponse (bandNr, ch, ir);
+                });
+
+        const ScopedLock sl (lock);
+        for (auto& kernelSet : kernelSets) // built by another thread meanwhile
+            if (kernelSet->getKey() == key)
+                return kernelSet;
+
+        kernelSets.add (newSet);
+        return newSet;
+    }
+
+    // the kernel set for this key if some instance has built it already, nothing is designed here
+    KernelSet::Ptr findKernelSet (const KernelSetKey& key)
+    {
+        const ScopedLock sl (lock);
+
+        for (int i = kernelSets.size(); --i >= 0;)
+            if (kernelSets.getReference (i)->getReferenceCount() == 1) // only referenced by the store
+                kernelSets.remove (i);
+
+        for (auto& kernelSet : kernelSets)
+            if (kernelSet->getKey() == key)
+                return kernelSet;
+
+        return nullptr;
+    }
+
+    // fft objects are stateless during processing and can be used by several instances at once
+    const dsp::FFT& getFft (int fftSize)
+    {
+        const ScopedLock sl (lock);
+        const int order = roundToInt (std::log2 (fftSize));
+
+        for (auto* fft : ffts)
+            if (fft->getSize() == fftSize)
+                return *fft;
+
+        return *ffts.add (new dsp::FFT (order));
+    }
+
+private:
+    BandKernel::Ptr findKernel (const KernelKey& key)
+    {
+        const ScopedLock sl (lock);
+
+        releaseUnusedKernels();
+
+        for (auto& kernel : kernels)
+            if (kernel->getKey() == key)
+                return kernel;
+
+        return nullptr;
+    }
+
+    void releaseUnusedKernels()
+    {
+        for (int i = kernels.size(); --i >= 0;)
+            if (kernels.getReference (i)->getReferenceCount() == 1) // only referenced by the store
+                kernels.remove (i);
+    }
+
+    CriticalSection lock;
+    Array<BandKernel::Ptr> kernels;
+    Array<KernelSet::Ptr> kernelSets;
+    OwnedArray<dsp::FFT> ffts;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (KernelStore)
+};
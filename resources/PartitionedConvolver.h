@@ -0,0 +1,319 @@
+/*
+ ==============================================================================
+ PartitionedConvolver.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "KernelStore.h"
+
+// Zero latency, uniformly partitioned mono convolution (same algorithm as juce::dsp::Convolution).
+// The kernel spectra are shared BandKernels from the KernelStore, only the input history and the
+// overlap buffers are owned per instance. New kernels are swapped in at a partition boundary and
+// crossfaded while their overlap builds up (one or three partitions).
+class PartitionedConvolver
+{
+public:
+    PartitionedConvolver() {}
+    ~PartitionedConvolver() {}
+
+    // message thread, audio processing must be stopped
+    void prepare (const dsp::ProcessSpec& spec, int maxKernelLength, KernelStore& store)
+    {
+        partitionSize = nextPowerOfTwo (jmax (1, static_cast<int> (spec.maximumBlockSize)));
+        fftSize = BandKernel::getFftSize (partitionSize);
+        fadeLength = fftSize - partitionSize;
+        fft = &store.getFft (fftSize);
+
+        indexStep = partitionSize > 128 ? 1 : 3;
+        numInputSegments = indexStep * BandKernel::getNumSegments (maxKernelLength, fftSize, partitionSize);
+
+        inputBuffer.setSize (1, fftSize);
+        inputSegments.setSize (numInputSegments, 2 * fftSize);
+        for (auto& lane : lanes)
+        {
+            lane.output.setSize (1, 2 * fftSize);
+            lane.tempOutput.setSize (1, 2 * fftSize);
+            lane.overlap.setSize (1, fftSize);
+            lane.kernel = nullptr;
+        }
+
+        const SpinLock::ScopedLockType sl (pendingLock);
+        if (hasPendingKernel)
+        {
+            if (pendingKernel == nullptr || pendingKernel->getKey().partitionSize == partitionSize)
+                lanes[current].kernel = pendingKernel;
+            pendingKernel = nullptr;
+            hasPendingKernel = false;
+        }
+
+        reset();
+    }
+
+    void reset()
+    {
+        inputBuffer.clear();
+        inputSegments.clear();
+        for (auto& lane : lanes)
+        {
+            lane.output.clear();
+            lane.tempOutput.clear();
+            lane.overlap.clear();
+        }
+        lanes[1 - current].kernel = nullptr;
+        inputDataPos = 0;
+        currentSegment = 0;
+        fadePos = fadeLength;
+    }
+
+    int getPartitionSize() const { return partitionSize; }
+
+    // any thread (offline renders set it from the audio thread): the kernel is used from the next partition on (nullptr = silence)
+    void setKernel (BandKernel::Ptr newKernel)
+    {
+        const SpinLock::ScopedLockType sl (pendingLock);
+        pendingKernel = std::move (newKernel);
+        hasPendingKernel = true;
+    }
+
+    void process (const dsp::ProcessContextReplacing<float>& context)
+    {
+        auto block = context.getOutputBlock();
+        float* data = block.getChannelPointer (0);
+        const int numSamples = static_cast<int> (block.getNumSamples());
+
+        if (fft == nullptr)
+        {
+            FloatVectorOperations::clear (data, numSamples);
+            return;
+        }
+
+        int numSamplesProcessed = 0;
+        float* inputData = inputBuffer.getWritePointer (0);
+
+        while (numSamplesProcessed < numSamples)
+        {
+            const bool inputDataWasEmpty = (inputDataPos == 0);
+            if (inputDataWasEmpty && fadePos >= fadeLength)
+                takePendingKernel();
+
+            const int numToProcess = jmin (numSamples - numSamplesProcessed, partitionSize - inputDataPos);
+
+            FloatVectorOperations::copy (inputData + inputDataPos, data + numSamplesProcessed, numToProcess);
+
+            float* inputSegment = inputSegments.getWritePointer (currentSegment);
+            FloatVectorOperations::copy (inputSegment, inputData, fftSize);
+            fft->performRealOnlyForwardTransform (inputSegment);
+            BandKernel::prepareForConvolution (inputSegment, fftSize);
+
+            const bool fading = fadePos < fadeLength && lanes[1 - current].kernel != nullptr;
+
+            processLane (lanes[current], inputDataWasEmpty);
+            if (fading)
+                processLane (lanes[1 - current], inputDataWasEmpty);
+
+            float* out = data + numSamplesProcessed;
+            const float* newOut = lanes[current].output.getReadPointer (0, inputDataPos);
+            const float* newOverlap = lanes[current].overlap.getReadPointer (0, inputDataPos);
+
+            if (lanes[current].kernel == nullptr)
+                FloatVectorOperations::clear (out, numToProcess);
+            else
+                FloatVectorOperations::add (out, newOut, newOverlap, numToProcess);
+
+            if (fading)
+            {
+                const float* oldOut = lanes[1 - current].output.getReadPointer (0, inputDataPos);
+                const float* oldOverlap = lanes[1 - current].overlap.getReadPointer (0, inputDataPos);
+                const float step = 1.0f / fadeLength;
+
+                for (int i = 0; i < numToProcess; ++i)
+                {
+                    const float gain = (fadePos + i) * step;
+                    out[i] = gain * out[i] + (1.0f - gain) * (oldOut[i] + oldOverlap[i]);
+                }
+            }
+            else if (lanes[current].kernel != nullptr && fadePos < fadeLength)
+            {
+                // fade in from silence
+                const float step = 1.0f / fadeLength;
+                for (int i = 0; i < numToProcess; ++i)
+                    out[i] *= (fadePos + i) * step;
+            }
+            fadePos = jmin (fadeLength, fadePos + numToProcess);
+
+            inputDataPos += numToProcess;
+
+            if (inputDataPos == partitionSize)
+            {
+                // input segment complete: save the overlap and advance the input history
+                FloatVectorOperations::fill (inputData, 0.0f, fftSize);
+                inputDataPos = 0;
+
+                saveOverlap (lanes[current]);
+                if (fading)
+                    saveOverlap (lanes[1 - current]);
+                else
+                    lanes[1 - current].kernel = nullptr; // fade finished
+
+                currentSegment = (currentSegment > 0) ? (currentSegment - 1) : (numInputSegments - 1);
+            }
+
+            numSamplesProcessed += numToProcess;
+        }
+    }
+
+private:
+    struct Lane
+    {
+        BandKernel::Ptr kernel;
+        AudioBuffer<float> output, tempOutput, overlap;
+    };
+
+    void takePendingKernel()
+    {
+        const SpinLock::ScopedTryLockType tl (pendingLock);
+        if (! tl.isLocked() || ! hasPendingKernel)
+            return;
+
+        if (pendingKernel != nullptr && pendingKernel->getKey().partitionSize != partitionSize)
+        {
+            hasPendingKernel = false; // built for a different block size, wait for the next prepare
+            return;
+        }
+
+        if (pendingKernel == lanes[current].kernel)
+        {
+            hasPendingKernel = false; // set again (e.g. an offline build applied once more), nothing to fade
+            pendingKernel = nullptr;
+            return;
+        }
+
+        // the previous kernel fades out while the overlap of the new one builds up; the store still references
+        // every kernel, so releasing the one replaced here never deallocates on the audio thread
+        current = 1 - current;
+        lanes[current].kernel = std::move (pendingKernel);
+        lanes[current].overlap.clear();
+        hasPendingKernel = false;
+        fadePos = 0;
+    }
+
+    void processLane (Lane& lane, bool inputDataWasEmpty)
+    {
+        if (lane.kernel == nullptr)
+            return;
+
+        const BandKernel& kernel = *lane.kernel;
+        float* outputData = lane.output.getWritePointer (0);
+        float* tempOutputData = lane.tempOutput.getWritePointer (0);
+
+        // contribution of the past input segments only changes once per partition
+        if (inputDataWasEmpty)
+        {
+            FloatVectorOperations::fill (tempOutputData, 0.0f, fftSize + 1);
+
+            int index = currentSegment;
+            for (int i = 1; i < kernel.getNumSegments(); ++i)
+            {
+                index += indexStep;
+                if (index >= numInputSegments)
+                    index -= numInputSegments;
+
+                multiplyAndAccumulate (inputSegments.getReadPointer (index), kernel.getSegment (i), tempOutputData);
+            }
+        }
+
+        FloatVectorOperations::copy (outputData, tempOutputData, fftSize + 1);
+        multiplyAndAccumulate (inputSegments.getReadPointer (currentSegment), kernel.getSegment (0), outputData);
+
+        updateSymmetricFrequencyDomainData (outputData);
+        fft->performRealOnlyInverseTransform (outputData);
+    }
+
+    void saveOverlap (Lane& lane)
+    {
+        if (lane.kernel == nullptr)
+            return;
+
+        float* outputData = lane.output.getWritePointer (0);
+        float* overlapData = lane.overlap.getWritePointer (0);
+
+        // extra step for fftSize > 2 * partitionSize
+        FloatVectorOperations::add (outputData + partitionSize, overlapData + partitionSize, fftSize - 2 * partitionSize);
+        FloatVectorOperations::copy (overlapData, outputData + partitionSize, fftSize - partitionSize);
+    }
+
+    void multiplyAndAccumulate (const float* input, const float* impulse, float* output) const noexcept
+    {
+        const int halfSize = fftSize / 2;
+
+        FloatVectorOperations::addWithMultiply (output, input, impulse, halfSize);
+        FloatVectorOperations::subtractWithMultiply (output, input + halfSize, impulse + halfSize, halfSize);
+
+        FloatVectorOperations::addWithMultiply (output + halfSize, input, impulse + halfSize, halfSize);
+        FloatVectorOperations::addWithMultiply (output + halfSize, input + halfSize, impulse, halfSize);
+
+        output[fftSize] += input[fftSize] * impulse[fftSize];
+    }
+
+    // back from split real / imaginary parts to the full complex spectrum the inverse fft expects
+    void updateSymmetricFrequencyDomainData (float* samples) const noexcept
+    {
+        const int halfSize = fftSize / 2;
+
+        for (int i = 1; i < halfSize; ++i)
+        {
+            samples[(fftSize - i) << 1] = samples[i];
+            samples[((fftSize - i) << 1) + 1] = -samples[halfSize + i];
+        }
+
+        samples[1] = 0.0f;
+        samples[fftSize + 1] = 0.0f;
+
+        for (int i = 1; i < halfSize; ++i)
+        {
+            samples[i << 1] = samples[(fftSize - i) << 1];
+            samples[(i << 1) + 1] = -samples[((fftSize - i) << 1) + 1];
+        }
+    }
+
+    const dsp::FFT* fft = nullptr;
+    int partitionSize = 0;
+    int fftSize = 0;
+    int indexStep = 1;
+    int numInputSegments = 0;
+    int inputDataPos = 0;
+    int currentSegment = 0;
+    int fadeLength = 0;
+    int fadePos = 0;
+
+    AudioBuffer<float> inputBuffer;
+    AudioBuffer<float> inputSegments; // frequency domain input history, one channel per segment
+
+    Lane lanes[2];
+    int current = 0;
+
+    SpinLock pendingLock;
+    BandKernel::Ptr pendingKernel;
+    bool hasPendingKernel = false;
+
+    JUCE_DECLARE_NON_COPYABLE (PartitionedConvolver)
+};
@@ -0,0 +1,178 @@
+/*
+ ==============================================================================
+ PatternOptimizer.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <cmath>
+#include <limits>
+
+// second order statistics of the omni and eight signal of one band
+struct BandStatistics
+{
+    float omniSq = 0.0f;
+    float eightSq = 0.0f;
+    float omniEight = 0.0f;
+
+    bool isEmpty() const { return omniSq == 0.0f && eightSq == 0.0f; }
+};
+
+// Closed form optimisation of the directivity factor alpha of one band.
+// The power of the pattern (1 - |alpha|) * omni + alpha * eight is a quadratic in alpha on
+// each side of alpha = 0, so the optimum is either an end of the allowed range, alpha = 0,
+// or a stationary point of one of the two quadratics (no grid search needed).
+struct PatternOptimizer
+{
+    // a * alpha^2 + b * alpha + c
+    struct Quadratic
+    {
+        double a, b, c;
+        double operator() (double alpha) const { return (a * alpha + b) * alpha + c; }
+    };
+
+    // alpha >= 0: (1 - alpha)^2 oo + alpha^2 ee + 2 (1 - alpha) alpha oe
+    // alpha <  0: (1 + alpha)^2 oo + alpha^2 ee + 2 (1 + alpha) alpha oe
+    static Quadratic getPowerQuadratic (const BandStatistics& s, bool backwards)
+    {
+        const double oo = s.omniSq, ee = s.eightSq, oe = s.omniEight;
+
+        if (backwards)
+            return { oo + ee + 2.0 * oe, 2.0 * (oo + oe), oo };
+
+        return { oo + ee - 2.0 * oe, 2.0 * (oe - oo), oo };
+    }
+
+    static double getPower (const BandStatistics& s, double alpha)
+    {
+        return getPowerQuadratic (s, alpha < 0.0) (alpha);
+    }
+
+    static float getMinimumPowerAlpha (const BandStatistics& s, float alphaMin, float alphaMax)
+    {
+        return findBest (s, s, alphaMin, alphaMax, [&s] (double alpha) { return -getPower (s, alpha); }, false);
+    }
+
+    static float getMaximumPowerAlpha (const BandStatistics& s, float alphaMin, float alphaMax)
+    {
+        return findBest (s, s, alphaMin, alphaMax, [&s] (double alpha) { return getPower (s, alpha); }, false);
+    }
+
+    // maximises signal power / disturber power (a 2x2 generalised eigenvalue problem per side)
+    static float getMaximumRatioAlpha (const BandStatistics& sig, const BandStatistics& dist, float alphaMin, float alphaMax)
+    {
+        return findBest (sig, dist, alphaMin, alphaMax, [&sig, &dist] (double alpha)
+        {
+            const double sigPower = getPower (sig, alpha);
+            const double distPower = getPower (dist, alpha);
+            if (distPower <= 0.0)
+                return sigPower > 0.0 ? std::numeric_limits<double>::max() : 0.0;
+            return sigPower / distPower;
+        }, true);
+    }
+
+private:
+    struct Candidates
+    {
+        double values[16];
+        int num = 0;
+
+        void add (double alpha, double lo, double hi)
+        {
+            if (std::isfinite (alpha) && alpha >= lo && alpha <= hi)
+                values[num++] = alpha;
+        }
+    };
+
+    // stationary point of a quadratic
+    static void addVertex (Candidates& c, const Quadratic& q, double lo, double hi)
+    {
+        if (q.a != 0.0)
+            c.add (-q.b / (2.0 * q.a), lo, hi);
+    }
+
+    // real roots of qa x^2 + qb x + qc
+    static void addRoots (Candidates& c, double qa, double qb, double qc, double lo, double hi)
+    {
+        if (qa == 0.0)
+        {
+            if (qb != 0.0)
+                c.add (-qc / qb, lo, hi);
+            return;
+        }
+
+        const double discriminant = qb * qb - 4.0 * qa * qc;
+        if (discriminant < 0.0)
+            return;
+
+        const double sqrtDiscriminant = std::sqrt (discriminant);
+        c.add ((-qb + sqrtDiscriminant) / (2.0 * qa), lo, hi);
+        c.add ((-qb - sqrtDiscriminant) / (2.0 * qa), lo, hi);
+    }
+
+    // stationary points of the ratio n / d: (n' d - n d') = 0 reduces to
+    // (a1 b2 - a2 b1) x^2 + 2 (a1 c2 - a2 c1) x + (b1 c2 - b2 c1) = 0.
+    // A root of d is a pattern that nulls the disturber completely, which beats any stationary point;
+    // the minimum of d covers nearly singular disturber statistics where the roots are lost to rounding.
+    static void addRatioCandidates (Candidates& c, const Quadratic& n, const Quadratic& d, double lo, double hi)
+    {
+        addRoots (c, n.a * d.b - d.a * n.b, 2.0 * (n.a * d.c - d.a * n.c), n.b * d.c - d.b * n.c, lo, hi);
+        addRoots (c, d.a, d.b, d.c, lo, hi);
+        addVertex (c, d, lo, hi);
+    }
+
+    template <typename Objective>
+    static float findBest (const BandStatistics& first, const BandStatistics& second, float alphaMin, float alphaMax,
+                           Objective objective, bool ratio)
+    {
+        Candidates c;
+        c.add (alphaMin, alphaMin, alphaMax);
+        c.add (alphaMax, alphaMin, alphaMax);
+        c.add (0.0, alphaMin, alphaMax);
+
+        for (const bool backwards : { true, false })
+        {
+            const double lo = backwards ? alphaMin : std::fmax (0.0, alphaMin);
+            const double hi = backwards ? std::fmin (0.0, alphaMax) : alphaMax;
+            if (lo > hi)
+                continue;
+
+            if (ratio)
+                addRatioCandidates (c, getPowerQuadratic (first, backwards), getPowerQuadratic (second, backwards), lo, hi);
+            else
+                addVertex (c, getPowerQuadratic (first, backwards), lo, hi);
+        }
+
+        // smallest alpha wins on ties, like the former grid search
+        double bestAlpha = alphaMin;
+        double bestValue = objective (bestAlpha);
+        for (int i = 0; i < c.num; ++i)
+        {
+            const double value = objective (c.values[i]);
+            if (value > bestValue || (value == bestValue && c.values[i] < bestAlpha))
+            {
+                bestValue = value;
+                bestAlpha = c.values[i];
+            }
+        }
+
+        return static_cast<float> (bestAlpha);
+    }
+};
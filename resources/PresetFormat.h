@@ -0,0 +1,158 @@
+/*
+ ==============================================================================
+ PresetFormat.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h> // also built into Tools/PresetTool, each project has its own
+#include "BandConfig.h"
+
+// The json preset files. A preset is parsed and validated completely before anything is applied,
+// so a broken file never leaves the plugin with half of its values.
+struct Preset
+{
+    int numBands = 5;
+    float xoverHz[4] = {};
+    float dirFactors[5] = {};
+    float gains[5] = {};
+    bool solo[5] = {};
+    bool mute[5] = {};
+    int eqMode = 0; // 0 = off, 1 = free field, 2 = diffuse field
+    float proximity = 0.0f;
+};
+
+class PresetFormat
+{
+public:
+    // value ranges of the plugin's parameters
+    static constexpr float DIR_FACTOR_MIN = -0.5f;
+    static constexpr float DIR_FACTOR_MAX = 1.0f;
+    static constexpr float GAIN_MIN = -24.0f;
+    static constexpr float GAIN_MAX = 18.0f;
+    static constexpr float PROXIMITY_MIN = -1.0f;
+    static constexpr float PROXIMITY_MAX = 1.0f;
+
+    // values that had to be changed to fit the plugin are listed in warnings
+    static Result parse (const String& jsonString, Preset& preset, StringArray* warnings = nullptr)
+    {
+        var parsedJson;
+        if (! JSON::parse (jsonString, parsedJson).wasOk() || ! parsedJson.isObject())
+            return Result::fail ("File could not be parsed: Please provide valid JSON!");
+
+        for (auto& property : getPropertyNames())
+            if (! parsedJson.hasProperty (property))
+                return Result::fail ("Corrupt preset file: No '" + property + "' property found.");
+
+        Preset result;
+        result.numBands = parsedJson.getProperty ("nrActiveBands", 0);
+        if (result.numBands < 1 || result.numBands > 5)
+            return Result::fail ("nrActiveBands needs to be between 1 and 5.");
+
+        // the crossovers are clamped to the ranges of the band count, which keeps them in ascending order;
+        // crossovers the band count doesn't use are dropped
+        StringArray changes;
+        const BandConfig& config = BandConfigs::get (result.numBands);
+        for (int i = 0; i < 4; ++i)
+        {
+            const String name ("xOverF" + String (i + 1));
+            const float hz = parsedJson.getProperty (name, 0.0f);
+            if (i >= result.numBands - 1)
+            {
+                if (hz != 0.0f)
+                    changes.add (name + " is not used with " + String (result.numBands) + " bands and was dropped.");
+                continue;
+            }
+
+            result.xoverHz[i] = jlimit (config.xoverRangeStart[i], config.xoverRangeEnd[i], hz);
+            if (result.xoverHz[i] != hz)
+                changes.add (name + " was moved from " + String (hz) + " Hz into its range of " + String (config.xoverRangeStart[i])
+                             + " to " + String (config.xoverRangeEnd[i]) + " Hz.");
+        }
+
+        // gains and proximity are clamped to their parameter ranges
+        auto getClamped = [&parsedJson, &changes] (const String& name, float minValue, float maxValue, const String& unit)
+        {
+            const float value = parsedJson.getProperty (name, 0.0f);
+            const float clamped = jlimit (minValue, maxValue, value);
+            if (clamped != value)
+                changes.add (name + " was clamped from " + String (value) + unit + " into its range of " + String (minValue)
+                             + " to " + String (maxValue) + unit + ".");
+            return clamped;
+        };
+
+        for (int i = 0; i < 5; ++i)
+        {
+            result.dirFactors[i] = parsedJson.getProperty ("dirFactor" + String (i + 1), 0.0f);
+            if (result.dirFactors[i] < DIR_FACTOR_MIN || result.dirFactors[i] > DIR_FACTOR_MAX)
+                return Result::fail ("DirFactor" + String (i + 1) + " needs to be between " + String (DIR_FACTOR_MIN)
+                                     + " and " + String (DIR_FACTOR_MAX) + ".");
+
+            result.gains[i] = getClamped ("gain" + String (i + 1), GAIN_MIN, GAIN_MAX, " dB");
+            result.solo[i] = static_cast<float> (parsedJson.getProperty ("solo" + String (i + 1), 0.0f)) >= 0.5f;
+            result.mute[i] = static_cast<float> (parsedJson.getProperty ("mute" + String (i + 1), 0.0f)) >= 0.5f;
+        }
+
+        result.eqMode = parsedJson.getProperty ("ffDfEq", 0);
+        if (result.eqMode < 0 || result.eqMode > 2)
+            return Result::fail ("ffDfEq needs to be 0 (off), 1 (free field) or 2 (diffuse field).");
+
+        result.proximity = getClamped ("proximity", PROXIMITY_MIN, PROXIMITY_MAX, String());
+
+        preset = result;
+        if (warnings != nullptr)
+            *warnings = changes;
+        return Result::ok();
+    }
+
+    static String toJson (const Preset& preset, const String& description)
+    {
+        DynamicObject* jsonObj = new DynamicObject();
+        jsonObj->setProperty ("Description", description);
+        jsonObj->setProperty ("nrActiveBands", preset.numBands);
+        for (int i = 0; i < 4; ++i)
+            jsonObj->setProperty ("xOverF" + String (i + 1), static_cast<int> (preset.xoverHz[i]));
+        for (int i = 0; i < 5; ++i)
+            jsonObj->setProperty ("dirFactor" + String (i + 1), preset.dirFactors[i]);
+        for (int i = 0; i < 5; ++i)
+            jsonObj->setProperty ("gain" + String (i + 1), preset.gains[i]);
+        for (int i = 0; i < 5; ++i)
+            jsonObj->setProperty ("solo" + String (i + 1), preset.solo[i] ? 1.0f : 0.0f);
+        for (int i = 0; i < 5; ++i)
+            jsonObj->setProperty ("mute" + String (i + 1), preset.mute[i] ? 1.0f : 0.0f);
+        jsonObj->setProperty ("ffDfEq", preset.eqMode);
+        jsonObj->setProperty ("proximity", preset.proximity);
+
+        return JSON::toString (var (jsonObj), false, 2);
+    }
+
+    static const StringArray& getPropertyNames()
+    {
+        static const StringArray propertyNames { "nrActiveBands", "xOverF1", "xOverF2", "xOverF3", "xOverF4",
+                                                 "dirFactor1", "dirFactor2", "dirFactor3", "dirFactor4", "dirFactor5",
+                                                 "gain1", "gain2", "gain3", "gain4", "gain5",
+                                                 "solo1", "solo2", "solo3", "solo4", "solo5",
+                                                 "mute1", "mute2", "mute3", "mute4", "mute5", "ffDfEq", "proximity" };
+        return propertyNames;
+    }
+
+private:
+    PresetFormat() = delete;
+};
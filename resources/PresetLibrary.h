@@ -0,0 +1,441 @@
+/*
+ ==============================================================================
+ PresetLibrary.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "BackgroundTaskQueue.h"
+#include "PresetFormat.h"
+#include <map>
+#include <set>
+
+// Index of the presets in a folder (and its sub folders) for the PresetBrowser, one per plugin instance, so instances
+// with different preset folders don't replace each other's folder. The metadata of every preset is kept in an index
+// file in the user's application data folder, shared by all instances; on a rescan only presets whose modification
+// time or size changed are parsed again. Nothing is scanned before the browser asks for it. Scanning and thumbnail
+// rendering run on the shared background thread, the index is replaced on the message thread and listeners get a
+// change message.
+class PresetLibrary : public ChangeBroadcaster
+{
+public:
+    struct Entry
+    {
+        File file;
+        int64 modificationTime = 0;
+        int64 size = 0;
+        int numBands = 0;
+        int eqMode = 0; // 0 = off, 1 = free field, 2 = diffuse field
+        float xoverHz[4] = {};
+        float dirFactors[5] = {};
+        float gains[5] = {};
+        float proximity = 0.0f;
+
+        String getName() const { return file.getFileNameWithoutExtension(); }
+
+        String getPatternSummary() const
+        {
+            StringArray patterns;
+            for (int i = 0; i < numBands; ++i)
+                patterns.add (getPatternName (dirFactors[i]));
+            return patterns.joinIntoString (", ");
+        }
+
+        String getEqName() const
+        {
+            return eqMode == 1 ? "free field eq" : eqMode == 2 ? "diffuse field eq" : "no eq";
+        }
+
+        String searchText; // lower case name and metadata, not stored in the index file
+    };
+
+    using ThumbnailCallback = std::function<void (const Image&)>;
+
+    PresetLibrary() {}
+    ~PresetLibrary() {}
+
+    // message thread: indexes folder in the background, nothing happens if it is indexed already
+    void setFolder (const File& newFolder)
+    {
+        if (newFolder == folder)
+            return;
+
+        folder = newFolder;
+        entries.clear();
+        thumbnails.clear();
+        sendChangeMessage();
+        refresh();
+    }
+
+    // message thread: scans the folder again (e.g. after a preset was saved)
+    void refresh()
+    {
+        if (! folder.isDirectory())
+            return;
+
+        const File scannedFolder (folder);
+        const File indexFile (getIndexFile (scannedFolder));
+        tasks.run ([this, scannedFolder, indexFile] (const std::atomic<bool>& cancelled) -> std::function<void()>
+        {
+            Array<Entry> cached;
+            readIndex (indexFile, cached);
+
+            bool changed = false;
+            Array<Entry> scanned = scan (scannedFolder, cached, changed, cancelled);
+            if (cancelled)
+                return {};
+            if (changed)
+                writeIndex (indexFile, scanned);
+            pruneThumbnails (getThumbnailFolder (scannedFolder), scanned);
+
+            return [this, scannedFolder, scanned]
+            {
+                if (scannedFolder != folder)
+                    return;
+
+                entries = scanned;
+                sendChangeMessage();
+            };
+        });
+    }
+
+    File getFolder() const { return folder; }
+    bool isScanning() const { return tasks.isBusy(); }
+    const Array<Entry>& getEntries() const { return entries; }
+
+    // Message thread. All whitespace separated terms have to appear in the name or the metadata,
+    // e.g. "vocal 3 bands cardioid" or "diffuse". An empty query returns all presets.
+    Array<Entry> search (const String& query) const
+    {
+        StringArray terms;
+        terms.addTokens (query.toLowerCase(), true);
+        terms.removeEmptyStrings();
+
+        Array<Entry> result;
+        for (auto& entry : entries)
+        {
+            bool matches = true;
+            for (auto& term : terms)
+                if (! entry.searchText.contains (term))
+                {
+                    matches = false;
+                    break;
+                }
+
+            if (matches)
+                result.add (entry);
+        }
+        return result;
+    }
+
+    // Message thread. Polar curves of the preset's bands (an entry of the current folder), rendered in the
+    // background and cached on disk next to the index; thumbnails of presets that changed or were removed are
+    // deleted by the next scan. The callback is called on the message thread, right away if the thumbnail is
+    // in memory.
+    void requestThumbnail (const Entry& entry, int size, const Array<Colour>& bandColours, ThumbnailCallback callback)
+    {
+        const String key (getThumbnailKey (entry, size, bandColours));
+        auto cached = thumbnails.find (key);
+        if (cached != thumbnails.end())
+        {
+            callback (cached->second);
+            return;
+        }
+
+        const File thumbnailFolder (getThumbnailFolder (folder));
+        tasks.run ([this, entry, size, bandColours, key, thumbnailFolder, callback] (const std::atomic<bool>&) -> std::function<void()>
+        {
+            const File thumbnailFile (thumbnailFolder.getChildFile (key + ".png"));
+            Image thumbnail (ImageFileFormat::loadFrom (thumbnailFile));
+            if (! thumbnail.isValid())
+            {
+                thumbnail = renderThumbnail (entry, size, bandColours);
+                thumbnailFolder.createDirectory();
+
+                // another instance may render the same thumbnail, the file is replaced at once
+                TemporaryFile temp (thumbnailFile);
+                {
+                    FileOutputStream out (temp.getFile());
+                    PNGImageFormat png;
+                    if (out.openedOk())
+                        png.writeImageToStream (thumbnail, out);
+                }
+                temp.overwriteTargetFileWithTemporary();
+            }
+
+            return [this, key, thumbnail, callback]
+            {
+                thumbnails[key] = thumbnail;
+                callback (thumbnail);
+            };
+        });
+    }
+
+    static String getPatternName (float dirFactor)
+    {
+        const float amount = std::abs (dirFactor);
+        const String name = amount < 0.15f ? "omni"
+                          : amount < 0.4f ? "wide cardioid"
+                          : amount < 0.57f ? "cardioid"
+                          : amount < 0.69f ? "supercardioid"
+                          : amount < 0.85f ? "hypercardioid"
+                          : "figure-of-eight";
+        return dirFactor < 0 && amount >= 0.15f ? "reverse " + name : name;
+    }
+
+    // any thread: metadata of a preset file, false if it is no valid preset
+    static bool readEntry (const File& presetFile, Entry& entry)
+    {
+        Preset preset;
+        if (! PresetFormat::parse (presetFile.loadFileAsString(), preset).wasOk())
+            return false;
+
+        entry.file = presetFile;
+        entry.numBands = preset.numBands;
+        entry.eqMode = preset.eqMode;
+        entry.proximity = preset.proximity;
+        std::copy (preset.xoverHz, preset.xoverHz + 4, entry.xoverHz);
+        std::copy (preset.dirFactors, preset.dirFactors + 5, entry.dirFactors);
+        std::copy (preset.gains, preset.gains + 5, entry.gains);
+        return true;
+    }
+
+private:
+    static constexpr int INDEX_MAGIC = 0x69724450; // "PDri"
+    static constexpr int INDEX_VERSION = 1;
+
+    static File getCacheFolder()
+    {
+        File cacheFolder (File::getSpecialLocation (File::userApplicationDataDirectory)
+                              .getChildFile ("AustrianAudio").getChildFile ("PolarDesigner preset index"));
+        cacheFolder.createDirectory();
+        return cacheFolder;
+    }
+
+    static File getIndexFile (const File& indexedFolder)
+    {
+        return getCacheFolder().getChildFile (String::toHexString (indexedFolder.getFullPathName().hashCode64()) + ".index");
+    }
+
+    static File getThumbnailFolder (const File& indexedFolder)
+    {
+        return getCacheFolder().getChildFile (String::toHexString (indexedFolder.getFullPathName().hashCode64()) + " thumbnails");
+    }
+
+    // the preset version part of a thumbnail key, see pruneThumbnails()
+    static String getThumbnailPrefix (const Entry& entry)
+    {
+        return String::toHexString (entry.file.getFullPathName().hashCode64()) + "_" + String (entry.modificationTime) + "_";
+    }
+
+    static String getThumbnailKey (const Entry& entry, int size, const Array<Colour>& bandColours)
+    {
+        int64 colourHash = 0;
+        for (auto& colour : bandColours)
+            colourHash = colourHash * 31 + static_cast<int64> (colour.getARGB());
+
+        return getThumbnailPrefix (entry) + String (size) + "_" + String::toHexString (colourHash);
+    }
+
+    // deletes the thumbnails of presets that are gone or have changed since they were rendered
+    static void pruneThumbnails (const File& thumbnailFolder, const Array<Entry>& indexed)
+    {
+        if (! thumbnailFolder.isDirectory())
+            return;
+
+        std::set<String> prefixes;
+        for (auto& entry : indexed)
+            prefixes.insert (getThumbnailPrefix (entry));
+
+        for (const auto& thumbnailFile : thumbnailFolder.findChildFiles (File::findFiles, false, "*.png"))
+        {
+            // <prefix><size>_<colours>
+            const String name (thumbnailFile.getFileNameWithoutExtension());
+            const String prefix (name.upToLastOccurrenceOf ("_", false, false).upToLastOccurrenceOf ("_", true, false));
+            if (prefixes.count (prefix) == 0)
+                thumbnailFile.deleteFile();
+        }
+    }
+
+    static void updateSearchText (Entry& entry)
+    {
+        entry.searchText = (entry.getName() + " " + String (entry.numBands) + (entry.numBands == 1 ? " band " : " bands ")
+                            + entry.getPatternSummary() + " " + entry.getEqName()).toLowerCase();
+    }
+
+    // only presets that changed since they were indexed are parsed
+    static Array<Entry> scan (const File& scannedFolder, const Array<Entry>& cached, bool& changed, const std::atomic<bool>& cancelled)
+    {
+        std::map<String, const Entry*> cachedByPath;
+        for (auto& entry : cached)
+            cachedByPath[entry.file.getFullPathName()] = &entry;
+
+        Array<Entry> result;
+        for (const auto& presetFile : scannedFolder.findChildFiles (File::findFiles, true, "*.json"))
+        {
+            if (cancelled)
+                break;
+
+            const int64 modificationTime = presetFile.getLastModificationTime().toMilliseconds();
+            const int64 size = presetFile.getSize();
+
+            auto known = cachedByPath.find (presetFile.getFullPathName());
+            if (known != cachedByPath.end() && known->second->modificationTime == modificationTime && known->second->size == size)
+            {
+                result.add (*known->second);
+                continue;
+            }
+
+            changed = true;
+            Entry entry;
+            if (! readEntry (presetFile, entry))
+                continue;
+
+            entry.modificationTime = modificationTime;
+            entry.size = size;
+            updateSearchText (entry);
+            result.add (entry);
+        }
+
+        if (result.size() != cached.size())
+            changed = true;
+
+        std::sort (result.begin(), result.end(), [] (const Entry& a, const Entry& b)
+        {
+            return a.getName().compareNatural (b.getName()) < 0;
+        });
+        return result;
+    }
+
+    static void readIndex (const File& indexFile, Array<Entry>& result)
+    {
+        FileInputStream in (indexFile);
+        if (! in.openedOk() || in.readInt() != INDEX_MAGIC || in.readInt() != INDEX_VERSION)
+            return;
+
+        const int numEntries = in.readInt();
+        for (int i = 0; i < numEntries && ! in.isExhausted(); ++i)
+        {
+            Entry entry;
+            entry.file = File (in.readString());
+            entry.modificationTime = in.readInt64();
+            entry.size = in.readInt64();
+            entry.numBands = jlimit (1, 5, in.readInt());
+            entry.eqMode = in.readInt();
+            for (auto& xover : entry.xoverHz)
+                xover = in.readFloat();
+            for (int band = 0; band < 5; ++band)
+            {
+                entry.dirFactors[band] = in.readFloat();
+                entry.gains[band] = in.readFloat();
+            }
+            entry.proximity = in.readFloat();
+
+            updateSearchText (entry);
+            result.add (entry);
+        }
+    }
+
+    static void writeIndex (const File& indexFile, const Array<Entry>& indexed)
+    {
+        TemporaryFile temp (indexFile);
+        {
+            FileOutputStream out (temp.getFile());
+            if (! out.openedOk())
+                return;
+
+            out.writeInt (INDEX_MAGIC);
+            out.writeInt (INDEX_VERSION);
+            out.writeInt (indexed.size());
+            for (auto& entry : indexed)
+            {
+                out.writeString (entry.file.getFullPathName());
+                out.writeInt64 (entry.modificationTime);
+                out.writeInt64 (entry.size);
+                out.writeInt (entry.numBands);
+                out.writeInt (entry.eqMode);
+                for (float xover : entry.xoverHz)
+                    out.writeFloat (xover);
+                for (int band = 0; band < 5; ++band)
+                {
+                    out.writeFloat (entry.dirFactors[band]);
+                    out.writeFloat (entry.gains[band]);
+                }
+                out.writeFloat (entry.proximity);
+            }
+        }
+        temp.overwriteTargetFileWithTemporary();
+    }
+
+    // same curves as the PolarPatternVisualizer: 25 dB range, one curve per band
+    static Image renderThumbnail (const Entry& entry, int size, const Array<Colour>& bandColours)
+    {
+        Image image (Image::ARGB, size, size, true, SoftwareImageType());
+        Graphics g (image);
+
+        // front up, as in the editor
+        const float centre = 0.5f * size;
+        const float radius = centre - 1.0f;
+        const AffineTransform transform (AffineTransform::fromTargetPoints (centre, centre, centre, centre - radius, centre - radius, centre));
+
+        Path circle;
+        circle.addEllipse (-1.0f, -1.0f, 2.0f, 2.0f);
+        circle.applyTransform (transform);
+        g.setColour (Colours::skyblue.withMultipliedAlpha (0.1f));
+        g.fillPath (circle);
+        g.setColour (Colours::white.withMultipliedAlpha (0.5f));
+        g.strokePath (circle, PathStrokeType (1.0f));
+
+        const int dbMin = 25;
+        for (int band = 0; band < entry.numBands; ++band)
+        {
+            const float dirWeight = entry.dirFactors[band];
+            Path pattern;
+            for (int phi = -180; phi <= 180; phi += 4)
+            {
+                const float phiInRad = degreesToRadians (static_cast<float> (phi));
+                const float gainLin = std::abs ((1 - std::abs (dirWeight)) + dirWeight * std::cos (phiInRad));
+                const float gainDb = 20 * std::log10 (std::max (gainLin, std::pow (10.0f, -dbMin / 20.0f)));
+                const float effGain = std::max (std::abs ((gainDb + dbMin) / dbMin), 0.01f);
+                const Point<float> point (effGain * std::cos (phiInRad), effGain * std::sin (phiInRad));
+
+                if (phi == -180)
+                    pattern.startNewSubPath (point);
+                else
+                    pattern.lineTo (point);
+            }
+            pattern.closeSubPath();
+            pattern.applyTransform (transform);
+
+            g.setColour (band < bandColours.size() ? bandColours[band] : Colours::white);
+            g.strokePath (pattern, PathStrokeType (1.5f));
+        }
+
+        return image;
+    }
+
+    File folder;
+    Array<Entry> entries;
+    std::map<String, Image> thumbnails;
+    BackgroundTaskQueue::Client tasks;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PresetLibrary)
+};
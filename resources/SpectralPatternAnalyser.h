@@ -0,0 +1,348 @@
+/*
+ ==============================================================================
+ SpectralPatternAnalyser.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "BandConfig.h"
+#include "BandEnergyTracker.h"
+#include "KernelStore.h"
+#include "PatternOptimizer.h"
+#include <vector>
+
+// Short time cross spectrum of the omni and eight signal: per fft bin the mean of |O|^2, |E|^2 and
+// Re(O E*), the same three moments the band statistics hold, but with a resolution of a few Hz.
+class SpectralPatternAnalyser
+{
+public:
+    static constexpr int FFT_ORDER = 11;
+    static constexpr int FFT_SIZE = 1 << FFT_ORDER;
+    static constexpr int HOP_SIZE = FFT_SIZE / 2;
+    static constexpr int NUM_BINS = FFT_SIZE / 2 + 1;
+
+    SpectralPatternAnalyser() {}
+    ~SpectralPatternAnalyser() {}
+
+    // message thread, while no samples are pushed
+    void prepare (double newSampleRate, KernelStore& store)
+    {
+        sampleRate = newSampleRate;
+        fft = &store.getFft (FFT_SIZE);
+
+        window.setSize (1, FFT_SIZE);
+        float* w = window.getWritePointer (0);
+        for (int i = 0; i < FFT_SIZE; ++i)
+            w[i] = 0.5f - 0.5f * std::cos (MathConstants<float>::twoPi * i / FFT_SIZE); // periodic hann
+
+        fifo.setSize (2, FFT_SIZE);
+        fftBuffer.setSize (2, 2 * FFT_SIZE);
+        binMoments.resize (NUM_BINS);
+
+        reset();
+    }
+
+    void reset()
+    {
+        fifo.clear();
+        for (auto& m : binMoments)
+            m = BandMoments();
+        fifoPos = 0;
+        samplesUntilNextFrame = FFT_SIZE;
+        numFrames = 0;
+    }
+
+    // audio thread: the sum of the bands of a filter bank (omni / eight of band i in channels 2 * i and 2 * i + 1),
+    // so the spectrum sees the same filtering (and eq) as the band statistics of that filter bank
+    void pushBands (const AudioBuffer<float>& filterBank, int nBands, int numSamples)
+    {
+        if (fft == nullptr)
+            return;
+
+        jassert (nBands <= 5 && 2 * nBands <= filterBank.getNumChannels());
+        const float* const* bands = filterBank.getArrayOfReadPointers();
+        float* fifoOmni = fifo.getWritePointer (0);
+        float* fifoEight = fifo.getWritePointer (1);
+        for (int i = 0; i < numSamples; ++i)
+        {
+            float omni = 0.0f, eight = 0.0f;
+            for (int band = 0; band < nBands; ++band)
+            {
+                omni += bands[2 * band][i];
+                eight += bands[2 * band + 1][i];
+            }
+            pushSample (fifoOmni, fifoEight, omni, eight);
+        }
+    }
+
+    int getNumFrames() const { return numFrames; }
+    double getSampleRate() const { return sampleRate; }
+    float getBinFrequency (int bin) const { return static_cast<float> (bin * sampleRate / FFT_SIZE); }
+
+    // sum of the bin moments [startBin, endBin), normalised to one frame
+    BandStatistics getStatistics (int startBin, int endBin) const
+    {
+        BandMoments sum;
+        for (int bin = startBin; bin < endBin; ++bin)
+            sum += binMoments.getReference (bin);
+        return sum.getMean (numFrames);
+    }
+
+private:
+    void pushSample (float* fifoOmni, float* fifoEight, float omni, float eight)
+    {
+        fifoOmni[fifoPos] = omni;
+        fifoEight[fifoPos] = eight;
+        if (++fifoPos == FFT_SIZE)
+            fifoPos = 0;
+
+        if (--samplesUntilNextFrame == 0)
+        {
+            analyseFrame();
+            samplesUntilNextFrame = HOP_SIZE;
+        }
+    }
+
+    void analyseFrame()
+    {
+        for (int ch = 0; ch < 2; ++ch)
+        {
+            const float* input = fifo.getReadPointer (ch);
+            const float* w = window.getReadPointer (0);
+            float* frame = fftBuffer.getWritePointer (ch);
+
+            // oldest sample first
+            const int numToEnd = FFT_SIZE - fifoPos;
+            FloatVectorOperations::multiply (frame, input + fifoPos, w, numToEnd);
+            FloatVectorOperations::multiply (frame + numToEnd, input, w + numToEnd, fifoPos);
+            FloatVectorOperations::clear (frame + FFT_SIZE, FFT_SIZE);
+
+            fft->performRealOnlyForwardTransform (frame);
+        }
+
+        const float* o = fftBuffer.getReadPointer (0);
+        const float* e = fftBuffer.getReadPointer (1);
+        for (int bin = 0; bin < NUM_BINS; ++bin)
+        {
+            const double oRe = o[2 * bin], oIm = o[2 * bin + 1];
+            const double eRe = e[2 * bin], eIm = e[2 * bin + 1];
+
+            BandMoments& m = binMoments.getReference (bin);
+            m.omniSq += oRe * oRe + oIm * oIm;
+            m.eightSq += eRe * eRe + eIm * eIm;
+            m.omniEight += oRe * eRe + oIm * eIm;
+        }
+        ++numFrames;
+    }
+
+    double sampleRate = 48000.0;
+    const dsp::FFT* fft = nullptr;
+
+    AudioBuffer<float> window;
+    AudioBuffer<float> fifo;      // last FFT_SIZE omni / eight samples
+    AudioBuffer<float> fftBuffer; // omni / eight frame
+    int fifoPos = 0;
+    int samplesUntilNextFrame = FFT_SIZE;
+
+    Array<BandMoments> binMoments;
+    int numFrames = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectralPatternAnalyser)
+};
+
+// Fits crossover frequencies and band alphas to recorded cross spectra. The spectrum is divided into
+// fractional octave groups, the optimal alpha is solved per group (the fine grid) and a dynamic program
+// chooses the group boundaries inside the crossover ranges of BandConfigs, so the resulting band split
+// is the best one for the chosen target with one alpha per band.
+struct SpectralPatternFit
+{
+    enum class Target
+    {
+        minimumDisturber, // least disturber energy
+        maximumSignal,    // most signal energy
+        maximumRatio      // best signal-to-disturber ratio (in dB, averaged over log frequency)
+    };
+
+    static constexpr int GROUPS_PER_OCTAVE = 24;
+    static constexpr float LOWEST_FREQUENCY = 20.0f;
+
+    int nBands = 0;
+    float xoverHz[4] = {};
+    float alphas[5] = {};
+
+    // fine grid: center frequency and optimal alpha of every group
+    Array<float> groupFrequencies, groupAlphas;
+
+    bool isValid() const { return nBands > 0; }
+
+    // signal or disturber may be nullptr if the target does not use it; returns an invalid fit without data
+    static SpectralPatternFit compute (const SpectralPatternAnalyser* signal, const SpectralPatternAnalyser* disturber,
+                                       Target target, int nBands, float alphaMin, float alphaMax)
+    {
+        SpectralPatternFit fit;
+        const bool needsSignal = target != Target::minimumDisturber;
+        const bool needsDisturber = target != Target::maximumSignal;
+        if ((needsSignal && (signal == nullptr || signal->getNumFrames() == 0))
+            || (needsDisturber && (disturber == nullptr || disturber->getNumFrames() == 0)))
+            return fit;
+
+        const SpectralPatternAnalyser& reference = needsSignal ? *signal : *disturber;
+        const Array<int> edges = getGroupEdges (reference);
+        const int numGroups = edges.size() - 1;
+        if (numGroups < nBands)
+            return fit;
+
+        // running sums over the groups, a band is the difference of two of them
+        std::vector<BandMoments> sigSums (numGroups + 1), distSums (numGroups + 1);
+        for (int g = 0; g < numGroups; ++g)
+        {
+            sigSums[g + 1] = sigSums[g];
+            distSums[g + 1] = distSums[g];
+            if (needsSignal)
+                sigSums[g + 1] += BandMoments::fromStatistics (signal->getStatistics (edges[g], edges[g + 1]));
+            if (needsDisturber)
+                distSums[g + 1] += BandMoments::fromStatistics (disturber->getStatistics (edges[g], edges[g + 1]));
+        }
+
+        // band [firstGroup, endGroup): alpha and cost (lower is better)
+        auto evaluate = [&] (int firstGroup, int endGroup, float& alpha)
+        {
+            const BandStatistics sig = BandMoments::difference (sigSums[endGroup], sigSums[firstGroup]).getMean (1.0);
+            const BandStatistics dist = BandMoments::difference (distSums[endGroup], distSums[firstGroup]).getMean (1.0);
+
+            switch (target)
+            {
+                case Target::minimumDisturber:
+                    alpha = PatternOptimizer::getMinimumPowerAlpha (dist, alphaMin, alphaMax);
+                    return PatternOptimizer::getPower (dist, alpha);
+                case Target::maximumSignal:
+                    alpha = PatternOptimizer::getMaximumPowerAlpha (sig, alphaMin, alphaMax);
+                    return -PatternOptimizer::getPower (sig, alpha);
+                case Target::maximumRatio:
+                default:
+                {
+                    alpha = PatternOptimizer::getMaximumRatioAlpha (sig, dist, alphaMin, alphaMax);
+                    const double ratio = PatternOptimizer::getPower (sig, alpha)
+                                         / jmax (1.0e-20, PatternOptimizer::getPower (dist, alpha));
+                    return -(endGroup - firstGroup) * 10.0 * std::log10 (jmax (1.0e-20, ratio));
+                }
+            }
+        };
+
+        fit.groupFrequencies.resize (numGroups);
+        fit.groupAlphas.resize (numGroups);
+        for (int g = 0; g < numGroups; ++g)
+        {
+            float alpha;
+            evaluate (g, g + 1, alpha);
+            fit.groupAlphas.set (g, alpha);
+            fit.groupFrequencies.set (g, 0.5f * (reference.getBinFrequency (edges[g]) + reference.getBinFrequency (edges[g + 1] - 1)));
+        }
+
+        // crossover c may sit on group edge j if its frequency lies inside the range of c
+        const BandConfig& config = BandConfigs::get (nBands);
+        auto isValidCrossover = [&] (int c, int j)
+        {
+            const float hz = getEdgeFrequency (reference, edges[j]);
+            return hz >= config.xoverRangeStart[c] && hz <= config.xoverRangeEnd[c];
+        };
+
+        // cost[k][j]: best cost of k + 1 bands covering groups [0, j)
+        const double infinity = std::numeric_limits<double>::infinity();
+        std::vector<std::vector<double>> cost (nBands, std::vector<double> (numGroups + 1, infinity));
+        std::vector<std::vector<int>> previousEdge (nBands, std::vector<int> (numGroups + 1, -1));
+
+        for (int k = 0; k < nBands; ++k)
+        {
+            for (int j = 1; j <= numGroups; ++j)
+            {
+                const bool isLast = (k == nBands - 1);
+                if (isLast != (j == numGroups) || (! isLast && ! isValidCrossover (k, j)))
+                    continue;
+
+                if (k == 0)
+                {
+                    float alpha;
+                    cost[k][j] = evaluate (0, j, alpha);
+                    previousEdge[k][j] = 0;
+                    continue;
+                }
+
+                for (int i = 1; i < j; ++i)
+                {
+                    if (cost[k - 1][i] == infinity)
+                        continue;
+
+                    float alpha;
+                    const double c = cost[k - 1][i] + evaluate (i, j, alpha);
+                    if (c < cost[k][j])
+                    {
+                        cost[k][j] = c;
+                        previousEdge[k][j] = i;
+                    }
+                }
+            }
+        }
+
+        if (cost[nBands - 1][numGroups] == infinity)
+            return fit;
+
+        int endGroup = numGroups;
+        for (int k = nBands - 1; k >= 0; --k)
+        {
+            const int firstGroup = previousEdge[k][endGroup];
+            evaluate (firstGroup, endGroup, fit.alphas[k]);
+            if (k > 0)
+                fit.xoverHz[k - 1] = jlimit (config.xoverRangeStart[k - 1], config.xoverRangeEnd[k - 1],
+                                             getEdgeFrequency (reference, edges[firstGroup]));
+            endGroup = firstGroup;
+        }
+
+        fit.nBands = nBands;
+        return fit;
+    }
+
+private:
+    // first bin of every group plus the end bin, groups have at least one bin
+    static Array<int> getGroupEdges (const SpectralPatternAnalyser& analyser)
+    {
+        Array<int> edges;
+        edges.add (0);
+
+        const double binWidth = analyser.getSampleRate() / SpectralPatternAnalyser::FFT_SIZE;
+        const double step = std::pow (2.0, 1.0 / GROUPS_PER_OCTAVE);
+        for (double hz = LOWEST_FREQUENCY; hz < 0.5 * analyser.getSampleRate(); hz *= step)
+        {
+            const int bin = roundToInt (hz / binWidth);
+            if (bin > edges.getLast() && bin < SpectralPatternAnalyser::NUM_BINS)
+                edges.add (bin);
+        }
+
+        edges.add (SpectralPatternAnalyser::NUM_BINS);
+        return edges;
+    }
+
+    // frequency between bin - 1 and bin
+    static float getEdgeFrequency (const SpectralPatternAnalyser& analyser, int bin)
+    {
+        return analyser.getBinFrequency (bin) - 0.5f * analyser.getBinFrequency (1);
+    }
+};
@@ -0,0 +1,356 @@
+/*
+ ==============================================================================
+ SpectralPatternEngine.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "KernelStore.h"
+
+// Alternative to the FIR filter bank: the omni and eight signal are mixed per fft bin (overlap-add of hann
+// windowed frames, 75 % overlap). Frames are zero padded to twice their length, so the eq responses (shorter
+// than a frame at every sample rate) filter linearly instead of wrapping around. alpha(f) and gain(f) are
+// interpolated on a log frequency axis between the band handles of the DirectivityEQ (the geometric band
+// centers), so the pattern changes smoothly instead of switching at the crossovers. Costs three ffts per hop,
+// independent of the number of bands.
+class SpectralPatternEngine
+{
+public:
+    static constexpr float MIN_FREQUENCY = 20.0f;    // band edges the DirectivityEQ places its handles between
+    static constexpr float MAX_FREQUENCY = 20000.0f;
+
+    SpectralPatternEngine() {}
+    ~SpectralPatternEngine() {}
+
+    // frame length for a sample rate: about 47 Hz resolution
+    static int getFrameSize (double sampleRate) { return nextPowerOfTwo (roundToInt (1024.0 * sampleRate / 48000.0)); }
+
+    // message thread, audio processing must be stopped
+    void prepare (double newSampleRate, KernelStore& store)
+    {
+        sampleRate = newSampleRate;
+        frameSize = getFrameSize (sampleRate);
+        fftSize = 2 * frameSize;
+        hopSize = frameSize / 4;
+        numBins = fftSize / 2 + 1;
+        fft = &store.getFft (fftSize);
+
+        window.setSize (1, frameSize);
+        float* w = window.getWritePointer (0);
+        for (int i = 0; i < frameSize; ++i)
+            w[i] = 0.5f - 0.5f * std::cos (MathConstants<float>::twoPi * i / frameSize); // periodic hann
+
+        inputFifo.setSize (2, fftSize);
+        outputFifo.setSize (1, fftSize);
+        frames.setSize (2, 2 * fftSize);
+        cachedResponses.clear();
+
+        // log2 of the bin frequencies, bin 0 is treated like bin 1
+        logBinFrequencies.setSize (1, numBins);
+        float* logF = logBinFrequencies.getWritePointer (0);
+        for (int k = 0; k < numBins; ++k)
+            logF[k] = std::log2 (static_cast<float> (jmax (1, k) * sampleRate / fftSize));
+
+        curves.setSize (2, numBins);  // alpha, gain
+        eq.setSize (4, numBins);      // omni re / im, eight re / im
+        pendingEq.setSize (4, numBins);
+        setFlatResponse (eq);
+        hasPendingEq = false;
+
+        lastNumBands = 0;
+        reset();
+    }
+
+    void reset()
+    {
+        inputFifo.clear();
+        outputFifo.clear();
+        fifoPos = 0;
+        samplesUntilNextFrame = hopSize;
+    }
+
+    int getLatency() const { return frameSize - 1; }
+
+    // Message thread (or the audio thread of an offline render): free field / diffuse field eq, nullptr = no eq.
+    // The responses come from EqImpulseResponseCache, which keeps them until it is destroyed, so their addresses
+    // identify sample rate and eq type: each one is transformed once per prepare().
+    void setEq (const AudioBuffer<float>* omniResponse, const AudioBuffer<float>* eightResponse)
+    {
+        if (numBins != fftSize / 2 + 1 || fft == nullptr)
+            return; // not prepared yet, prepare() starts without eq
+
+        const AudioBuffer<float>* response = nullptr;
+        if (omniResponse != nullptr && eightResponse != nullptr)
+            response = &getCachedResponse (*omniResponse, *eightResponse);
+
+        const SpinLock::ScopedLockType sl (eqLock);
+        if (response == nullptr)
+            setFlatResponse (pendingEq);
+        else
+            for (int ch = 0; ch < 4; ++ch)
+                FloatVectorOperations::copy (pendingEq.getWritePointer (ch), response->getReadPointer (ch), numBins);
+        hasPendingEq = true;
+    }
+
+    // audio thread, once per block: crossovers and band values as set by the DirectivityEQ,
+    // gains are linear (0 for muted bands)
+    void setBands (int numBands, const float* xoverHz, const float* alphas, const float* gains)
+    {
+        if (numBands == lastNumBands
+            && std::equal (xoverHz, xoverHz + numBands - 1, lastXoverHz)
+            && std::equal (alphas, alphas + numBands, lastAlphas)
+            && std::equal (gains, gains + numBands, lastGains))
+            return;
+
+        lastNumBands = numBands;
+        std::copy (xoverHz, xoverHz + numBands - 1, lastXoverHz);
+        std::copy (alphas, alphas + numBands, lastAlphas);
+        std::copy (gains, gains + numBands, lastGains);
+
+        // handle positions: geometric centers of the bands
+        float logCenters[5];
+        for (int i = 0; i < numBands; ++i)
+        {
+            const float lower = i == 0 ? MIN_FREQUENCY : xoverHz[i - 1];
+            const float upper = i == numBands - 1 ? MAX_FREQUENCY : xoverHz[i];
+            logCenters[i] = 0.5f * (std::log2 (lower) + std::log2 (upper));
+        }
+
+        const float* logF = logBinFrequencies.getReadPointer (0);
+        float* alphaCurve = curves.getWritePointer (0);
+        float* gainCurve = curves.getWritePointer (1);
+
+        int band = 0;
+        for (int k = 0; k < numBins; ++k)
+        {
+            while (band < numBands - 1 && logF[k] >= logCenters[band + 1])
+                ++band;
+
+            if (logF[k] <= logCenters[0] || band == numBands - 1)
+            {
+                alphaCurve[k] = alphas[band];
+                gainCurve[k] = gains[band];
+                continue;
+            }
+
+            const float t = (logF[k] - logCenters[band]) / (logCenters[band + 1] - logCenters[band]);
+            alphaCurve[k] = alphas[band] + t * (alphas[band + 1] - alphas[band]);
+            gainCurve[k] = gains[band] + t * (gains[band + 1] - gains[band]);
+        }
+    }
+
+    // audio thread: output has a latency of getLatency() samples, output may alias omni or eight
+    void process (const float* omni, const float* eight, float* output, int numSamples)
+    {
+        if (fft == nullptr)
+        {
+            FloatVectorOperations::clear (output, numSamples);
+            return;
+        }
+
+        takePendingEq();
+
+        int pos = 0;
+        while (pos < numSamples)
+        {
+            const int numToProcess = jmin (numSamples - pos, samplesUntilNextFrame, fftSize - fifoPos);
+
+            FloatVectorOperations::copy (inputFifo.getWritePointer (0, fifoPos), omni + pos, numToProcess);
+            FloatVectorOperations::copy (inputFifo.getWritePointer (1, fifoPos), eight + pos, numToProcess);
+
+            // a frame is due after the last sample of this chunk; the samples before it can be read out first,
+            // as the frame overwrites their ring positions with the start of the next output cycle
+            samplesUntilNextFrame -= numToProcess;
+            const bool frameDue = samplesUntilNextFrame == 0;
+
+            readOutput (output + pos, frameDue ? numToProcess - 1 : numToProcess);
+            if (frameDue)
+            {
+                processFrame ((fifoPos + numToProcess) % fftSize);
+                readOutput (output + pos + numToProcess - 1, 1, numToProcess - 1);
+                samplesUntilNextFrame = hopSize;
+            }
+
+            fifoPos = (fifoPos + numToProcess) % fftSize;
+            pos += numToProcess;
+        }
+    }
+
+private:
+    // Both rings hold fftSize samples at the same positions. The output lags the input by frameSize - 1
+    // samples; a frame adds fftSize output samples starting at its oldest input sample.
+    void readOutput (float* dest, int numSamples, int offset = 0)
+    {
+        float* out = outputFifo.getWritePointer (0);
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const int readPos = (fifoPos + offset + i + 1 - frameSize + fftSize) % fftSize;
+            dest[i] = out[readPos];
+            out[readPos] = 0.0f;
+        }
+    }
+
+    // frameEnd: ring position after the newest sample of the frame
+    void processFrame (int frameEnd)
+    {
+        const float* w = window.getReadPointer (0);
+        const int frameStart = (frameEnd - frameSize + fftSize) % fftSize;
+        const int numToEnd = jmin (frameSize, fftSize - frameStart);
+
+        for (int ch = 0; ch < 2; ++ch)
+        {
+            const float* input = inputFifo.getReadPointer (ch);
+            float* frame = frames.getWritePointer (ch);
+            FloatVectorOperations::multiply (frame, input + frameStart, w, numToEnd);
+            FloatVectorOperations::multiply (frame + numToEnd, input, w + numToEnd, frameSize - numToEnd);
+            FloatVectorOperations::clear (frame + frameSize, 2 * fftSize - frameSize); // zero padding
+            fft->performRealOnlyForwardTransform (frame);
+        }
+
+        float* o = frames.getWritePointer (0);
+        const float* e = frames.getReadPointer (1);
+        const float* alphaCurve = curves.getReadPointer (0);
+        const float* gainCurve = curves.getReadPointer (1);
+        const float* eqOmniRe = eq.getReadPointer (0);
+        const float* eqOmniIm = eq.getReadPointer (1);
+        const float* eqEightRe = eq.getReadPointer (2);
+        const float* eqEightIm = eq.getReadPointer (3);
+
+        // y = gain * ((1 - |alpha|) * eqOmni * omni + alpha * eqEight * eight)
+        for (int k = 0; k < numBins; ++k)
+        {
+            const float omniWeight = (1.0f - std::abs (alphaCurve[k])) * gainCurve[k];
+            const float eightWeight = alphaCurve[k] * gainCurve[k];
+
+            const float omniRe = eqOmniRe[k] * o[2 * k] - eqOmniIm[k] * o[2 * k + 1];
+            const float omniIm = eqOmniRe[k] * o[2 * k + 1] + eqOmniIm[k] * o[2 * k];
+            const float eightRe = eqEightRe[k] * e[2 * k] - eqEightIm[k] * e[2 * k + 1];
+            const float eightIm = eqEightRe[k] * e[2 * k + 1] + eqEightIm[k] * e[2 * k];
+
+            o[2 * k] = omniWeight * omniRe + eightWeight * eightRe;
+            o[2 * k + 1] = omniWeight * omniIm + eightWeight * eightIm;
+        }
+
+        // real output: dc and nyquist are real, upper half mirrors the lower one
+        o[1] = 0.0f;
+        o[fftSize + 1] = 0.0f;
+        for (int k = 1; k < fftSize / 2; ++k)
+        {
+            o[2 * (fftSize - k)] = o[2 * k];
+            o[2 * (fftSize - k) + 1] = -o[2 * k + 1];
+        }
+
+        fft->performRealOnlyInverseTransform (o);
+
+        // hann windows overlap to 2 at a quarter hop
+        float* out = outputFifo.getWritePointer (0);
+        for (int i = 0; i < fftSize; ++i)
+        {
+            const int ringPos = (frameStart + i) % fftSize;
+            out[ringPos] += 0.5f * o[i];
+        }
+    }
+
+    void takePendingEq()
+    {
+        const SpinLock::ScopedTryLockType tl (eqLock);
+        if (! tl.isLocked() || ! hasPendingEq)
+            return;
+
+        for (int ch = 0; ch < 4; ++ch)
+            FloatVectorOperations::copy (eq.getWritePointer (ch), pendingEq.getReadPointer (ch), numBins);
+        hasPendingEq = false;
+    }
+
+    void setFlatResponse (AudioBuffer<float>& response)
+    {
+        response.clear();
+        FloatVectorOperations::fill (response.getWritePointer (0), 1.0f, numBins);
+        FloatVectorOperations::fill (response.getWritePointer (2), 1.0f, numBins);
+    }
+
+    // omni re / im, eight re / im of an eq, transformed on first use
+    const AudioBuffer<float>& getCachedResponse (const AudioBuffer<float>& omniResponse, const AudioBuffer<float>& eightResponse)
+    {
+        for (auto* cached : cachedResponses)
+            if (cached->omni == &omniResponse && cached->eight == &eightResponse)
+                return cached->response;
+
+        auto* cached = cachedResponses.add (new CachedResponse { &omniResponse, &eightResponse, AudioBuffer<float> (4, numBins) });
+        computeResponse (omniResponse, cached->response.getWritePointer (0), cached->response.getWritePointer (1));
+        computeResponse (eightResponse, cached->response.getWritePointer (2), cached->response.getWritePointer (3));
+        return cached->response;
+    }
+
+    // frequency response at the bin frequencies; a response longer than the fft would be folded, the eq
+    // responses are shorter than a frame, so they also fit the zero padding of the frames
+    void computeResponse (const AudioBuffer<float>& impulseResponse, float* re, float* im) const
+    {
+        const float* h = impulseResponse.getReadPointer (0);
+        const int length = impulseResponse.getNumSamples();
+        jassert (length <= fftSize - frameSize + 1);
+
+        HeapBlock<float> spectrum (2 * fftSize, true);
+        for (int n = 0; n < length; ++n)
+            spectrum[n % fftSize] += h[n];
+
+        fft->performRealOnlyForwardTransform (spectrum);
+        for (int k = 0; k < numBins; ++k)
+        {
+            re[k] = spectrum[2 * k];
+            im[k] = spectrum[2 * k + 1];
+        }
+    }
+
+    double sampleRate = 48000.0;
+    int frameSize = 1024;
+    int fftSize = 2048;
+    int hopSize = 256;
+    int numBins = 1025;
+    const dsp::FFT* fft = nullptr;
+
+    AudioBuffer<float> window;
+    AudioBuffer<float> inputFifo;  // ring buffer of the last fftSize omni / eight samples
+    AudioBuffer<float> outputFifo; // overlap-add ring buffer, same positions as the input
+    AudioBuffer<float> frames;
+    int fifoPos = 0;
+    int samplesUntilNextFrame = 256;
+
+    AudioBuffer<float> logBinFrequencies;
+    AudioBuffer<float> curves;
+    int lastNumBands = 0;
+    float lastXoverHz[4] = {}, lastAlphas[5] = {}, lastGains[5] = {};
+
+    AudioBuffer<float> eq;
+    SpinLock eqLock;
+    AudioBuffer<float> pendingEq;
+    bool hasPendingEq = false;
+
+    struct CachedResponse
+    {
+        const AudioBuffer<float>* omni;
+        const AudioBuffer<float>* eight;
+        AudioBuffer<float> response;
+    };
+    OwnedArray<CachedResponse> cachedResponses; // at most the two eq types of the prepared sample rate
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectralPatternEngine)
+};
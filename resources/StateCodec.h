@@ -0,0 +1,139 @@
+/*
+ ==============================================================================
+ StateCodec.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+
+#include <JuceHeader.h> // also built into Tools/PresetTool, each project has its own
+
+// Binary plugin state: a fixed layout of the parameter values of both A/B layers, no ValueTree or xml involved.
+// Hosts ask for the state for every undo step and autosave, so this has to be cheap.
+//
+// Layout (little endian): magic, version, number of parameters, then per layer ffDfEq, oldProxDistance and
+// the denormalised parameter values in the order of parameterIds, finally the sync group name.
+// The layout only ever grows: new parameters are appended to parameterIds, new fields go to the end.
+// A reader ignores parameters it does not know and keeps the values it was given for missing ones.
+class StateCodec
+{
+public:
+    static constexpr int VERSION = 1;
+    static constexpr int NUM_PARAMETERS = 33;
+
+    static const char* getParameterId (int index)
+    {
+        static const char* const parameterIds[NUM_PARAMETERS] =
+        {
+            "xOverF1", "xOverF2", "xOverF3", "xOverF4",
+            "alpha1", "alpha2", "alpha3", "alpha4", "alpha5",
+            "solo1", "solo2", "solo3", "solo4", "solo5",
+            "mute1", "mute2", "mute3", "mute4", "mute5",
+            "gain1", "gain2", "gain3", "gain4", "gain5",
+            "nrBands", "allowBackwardsPattern", "proximity", "zeroDelayMode", "syncChannel",
+            "adaptiveMode", "spectralFit", "spectralEngine", "abMorph"
+        };
+        return parameterIds[index];
+    }
+
+    static int getParameterIndex (const String& parameterId)
+    {
+        for (int i = 0; i < NUM_PARAMETERS; ++i)
+            if (parameterId == getParameterId (i))
+                return i;
+
+        jassertfalse;
+        return -1;
+    }
+
+    struct Layer
+    {
+        float values[NUM_PARAMETERS] = {};
+        int ffDfEq = 0;
+        float oldProxDistance = 0.0f;
+    };
+
+    struct State
+    {
+        Layer layers[2]; // A, B
+        String syncGroup;
+    };
+
+    static void write (const State& state, MemoryBlock& destData)
+    {
+        destData.reset();
+        MemoryOutputStream out (destData, false);
+        out.writeInt (MAGIC);
+        out.writeInt (VERSION);
+        out.writeInt (NUM_PARAMETERS);
+
+        for (auto& layer : state.layers)
+        {
+            out.writeInt (layer.ffDfEq);
+            out.writeFloat (layer.oldProxDistance);
+            for (float value : layer.values)
+                out.writeFloat (value);
+        }
+
+        out.writeString (state.syncGroup);
+    }
+
+    // true if data is a binary state, false for the xml states of older versions (or damaged data),
+    // state is only modified on success
+    static bool read (const void* data, int sizeInBytes, State& state)
+    {
+        if (data == nullptr || sizeInBytes < 3 * static_cast<int> (sizeof (int)))
+            return false;
+
+        MemoryInputStream in (data, static_cast<size_t> (sizeInBytes), false);
+        if (in.readInt() != MAGIC)
+            return false;
+
+        const int version = in.readInt();
+        const int numParameters = in.readInt();
+        if (version < 1 || numParameters < 0 || numParameters > MAX_PARAMETERS
+            || in.getNumBytesRemaining() < 2 * (2 + numParameters) * static_cast<int64> (sizeof (float)))
+            return false;
+
+        State result (state);
+        for (auto& layer : result.layers)
+        {
+            layer.ffDfEq = in.readInt();
+            layer.oldProxDistance = in.readFloat();
+            for (int i = 0; i < numParameters; ++i)
+            {
+                const float value = in.readFloat();
+                if (i < NUM_PARAMETERS)
+                    layer.values[i] = value;
+            }
+        }
+
+        if (! in.isExhausted())
+            result.syncGroup = in.readString();
+
+        state = result;
+        return true;
+    }
+
+private:
+    static constexpr int MAGIC = 0x74734450; // "PDst"
+    static constexpr int MAX_PARAMETERS = 1024; // sanity limit for damaged data
+
+    StateCodec() = delete;
+};
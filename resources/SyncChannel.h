@@ -0,0 +1,127 @@
+/*
+ ==============================================================================
+ SyncChannel.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+// Versioned snapshot shared between plugin instances. The snapshot is guarded by a sequence lock:
+// readers never block and retry if a write was in progress, writers are serialised by a spin lock.
+// Subscribers are woken (AsyncUpdater) only when another instance published a change.
+// The audio thread may read the snapshot directly, but that only makes a difference for fields it can apply
+// on its own: the plugin's sync groups mix the linked alpha / gain ramps within the block, every other field
+// (band count, crossovers, mute / solo, proximity, eq, ...) reaches the other instances on their message
+// thread, one message loop turn or more later.
+template <typename Snapshot>
+class SyncChannel
+{
+    static_assert (std::is_trivially_copyable<Snapshot>::value, "the snapshot is copied word by word");
+
+public:
+    SyncChannel()
+    {
+        for (auto& word : words)
+            word.store (0, std::memory_order_relaxed);
+    }
+
+    // Any thread. modify gets the current snapshot and returns false if it did not change anything,
+    // then nothing is published. All subscribers but the publisher are notified.
+    template <typename ModifyFunction>
+    void publish (ModifyFunction&& modify, const AsyncUpdater* publisher = nullptr)
+    {
+        const SpinLock::ScopedLockType sl (writeLock);
+
+        Snapshot snapshot;
+        load (snapshot);
+        if (! modify (snapshot))
+            return;
+
+        const uint32 previous = version.load (std::memory_order_relaxed);
+        version.store (previous + 1, std::memory_order_relaxed); // odd: write in progress
+        std::atomic_thread_fence (std::memory_order_release);
+        store (snapshot);
+        version.store (previous + 2, std::memory_order_release);
+
+        for (auto* subscriber : subscribers)
+            if (subscriber != publisher)
+                subscriber->triggerAsyncUpdate();
+    }
+
+    // any thread, lock-free: consistent copy of the snapshot, returns its (always even) version
+    uint32 read (Snapshot& destination) const
+    {
+        for (;;)
+        {
+            const uint32 before = version.load (std::memory_order_acquire);
+            if ((before & 1) == 0)
+            {
+                load (destination);
+                std::atomic_thread_fence (std::memory_order_acquire);
+                if (version.load (std::memory_order_relaxed) == before)
+                    return before;
+            }
+            Thread::yield();
+        }
+    }
+
+    void subscribe (AsyncUpdater* subscriber)
+    {
+        const SpinLock::ScopedLockType sl (writeLock);
+        subscribers.addIfNotAlreadyThere (subscriber);
+    }
+
+    void unsubscribe (AsyncUpdater* subscriber)
+    {
+        const SpinLock::ScopedLockType sl (writeLock);
+        subscribers.removeFirstMatchingValue (subscriber);
+    }
+
+private:
+    static constexpr size_t numWords = (sizeof (Snapshot) + sizeof (uint32) - 1) / sizeof (uint32);
+
+    void load (Snapshot& destination) const
+    {
+        uint32 buffer[numWords];
+        for (size_t i = 0; i < numWords; ++i)
+            buffer[i] = words[i].load (std::memory_order_relaxed);
+        std::memcpy (&destination, buffer, sizeof (Snapshot));
+    }
+
+    void store (const Snapshot& source)
+    {
+        uint32 buffer[numWords] = {};
+        std::memcpy (buffer, &source, sizeof (Snapshot));
+        for (size_t i = 0; i < numWords; ++i)
+            words[i].store (buffer[i], std::memory_order_relaxed);
+    }
+
+    std::atomic<uint32> version { 0 };
+    std::atomic<uint32> words[numWords];
+
+    SpinLock writeLock;
+    Array<AsyncUpdater*> subscribers;
+
+    JUCE_DECLARE_NON_COPYABLE (SyncChannel)
+};
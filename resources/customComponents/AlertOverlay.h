@@ -150,7 +150,9 @@ public:
         }
         else if (type == disturberTracking || type == Type::signalTracking)
         {
-            g.drawFittedText (message, mL + dvWidth + horSpace, mT + titleHeight + textMargin, width - mL - mR - dvWidth, messageHeight, Justification::topLeft, 5, 1.0f);
+            const int statusHeight = status.isEmpty() ? 0 : 20;
+            g.drawFittedText (message, mL + dvWidth + horSpace, mT + titleHeight + textMargin, width - mL - mR - dvWidth, messageHeight - statusHeight, Justification::topLeft, 5, 1.0f);
+            g.drawFittedText (status, mL + dvWidth + horSpace, height - buttonHeight - mB - textMargin - statusHeight, width - mL - mR - dvWidth, statusHeight, Justification::bottomLeft, 1, 1.0f);
         }
     }
     
@@ -224,6 +226,16 @@ public:
     void setTitle (String newTitle) {title = newTitle;}
     void setMessage (String newMessage) {message = newMessage;}
     
+    // one line below the message, e.g. the progress of the tracking
+    void setStatus (String newStatus)
+    {
+        if (status != newStatus)
+        {
+            status = newStatus;
+            repaint();
+        }
+    }
+    
     void enableRatioButton(bool enable)
     {
         if (tbRatio != nullptr)
@@ -288,6 +300,7 @@ private:
     Type type;
     String title;
     String message;
+    String status;
     
     std::function<void ()> onOkayCallback;
     std::function<void ()> onCancelCallback;
@@ -175,10 +175,7 @@ public:
 
     void paint (Graphics& g) override
     {
-        nrActiveBands = processor.getNBands();
-        
-        if (processor.zeroDelayModeActive())
-            nrActiveBands = 1;
+        nrActiveBands = getNumActiveBands();
         
         // make sure visibility of paths for grabbing is on for active bands and if no mouse dragging occurs
         if (nrActiveBands != oldNrActiveBands && activeElem == -1)
@@ -199,90 +196,18 @@ public:
             }
         }
         
-        // directivity labels
-        int height = getHeight();
-        int dirImgSize = 20;
-        int smallImgSize = 15;
-        float strokeSizeThin = 0.5f;
-        float strokeSizeThick = 2.0f;
-        eightPath.applyTransform (eightPath.getTransformToScaleToFit (5.0f, mT - dirImgSize / 2, dirImgSize, dirImgSize, true, Justification::left));
-        g.setColour (Colours::white);
-        g.strokePath (eightPath, PathStrokeType (activePatternPath == eightFact ? strokeSizeThick : strokeSizeThin));
-        g.fillPath (eightPath);
-        
-        hCardPath.applyTransform (hCardPath.getTransformToScaleToFit (mL / 2 - 15.0f, static_cast<float>(height) / 6 + 3.0f, smallImgSize, smallImgSize, true, Justification::right));
-        g.strokePath (hCardPath, PathStrokeType (activePatternPath == hCardFact ? strokeSizeThick : strokeSizeThin));
-        g.fillPath (hCardPath);
-        
-        sCardPath.applyTransform (sCardPath.getTransformToScaleToFit (mL / 2 - 14.0f, static_cast<float>(height) / 4, smallImgSize, smallImgSize, true, Justification::right));
-        g.strokePath (sCardPath, PathStrokeType (activePatternPath == sCardFact ? strokeSizeThick : strokeSizeThin));
-        g.fillPath (sCardPath);
-        
-        cardPath.applyTransform (cardPath.getTransformToScaleToFit (1.0f, static_cast<float>(height) / 3 - dirImgSize / 2 + 4.0f, dirImgSize, dirImgSize, true, Justification::right));
-        g.strokePath (cardPath, PathStrokeType (activePatternPath == cardFact ? strokeSizeThick : strokeSizeThin));
-        g.fillPath (cardPath);
-        
-        bCardPath.applyTransform (bCardPath.getTransformToScaleToFit (mL / 2 - 13.0f, static_cast<float>(height) / 2 - 27.0f, smallImgSize, smallImgSize, true, Justification::right));
-        g.strokePath (bCardPath, PathStrokeType (activePatternPath == bCardFact ? strokeSizeThick : strokeSizeThin));
-        g.fillPath (bCardPath);
-        
-        omniPath.applyTransform (omniPath.getTransformToScaleToFit (1.0f, static_cast<float>(height) * 2 / 3 - dirImgSize / 2 - 6.0f, dirImgSize, dirImgSize, true, Justification::right));
-        g.strokePath (omniPath, PathStrokeType (activePatternPath == omniFact ? strokeSizeThick : strokeSizeThin));
-        g.fillPath (omniPath);
-        
-        rbCardPath.applyTransform (rbCardPath.getTransformToScaleToFit (mL / 2 - 13.0f, static_cast<float>(height) - mB - smallImgSize / 2 - 22.0f, smallImgSize, smallImgSize, true, Justification::right));
-        g.strokePath (rbCardPath, PathStrokeType (activePatternPath == rbCardFact ? strokeSizeThick : strokeSizeThin));
-        g.fillPath (rbCardPath);
-        
-        rCardPath.applyTransform (rCardPath.getTransformToScaleToFit (1.0f, static_cast<float>(height) - mB - dirImgSize / 2, dirImgSize, dirImgSize, true, Justification::right));
-        g.strokePath (rCardPath, PathStrokeType (activePatternPath == rCardFact ? strokeSizeThick : strokeSizeThin));
-        g.fillPath (rCardPath);
+        // grid, labels and pattern icons only change with the size, they are rendered once into an image
+        const float scaleFactor = g.getInternalContext().getPhysicalPixelScaleFactor();
+        if (backgroundImage.isNull() || scaleFactor != backgroundScaleFactor)
+            renderBackground (scaleFactor);
+        g.drawImageTransformed (backgroundImage, AffineTransform::scale (1.0f / backgroundScaleFactor));
         
-        // frequency labels
-        g.setFont (getLookAndFeel().getTypefaceForFont (Font(12.0f, 2)));
-        g.setFont (16.0f);
-        for (float f=s.fMin; f <= s.fMax; f += powf(10, floorf(log10(f))))
+        // highlight of the pattern icon under the mouse
+        if (Path* patternPath = getPatternPath (activePatternPath))
         {
-            int xpos = hzToX(f);
-
-            String axislabel;
-            bool drawText = false;
-
-            if ((f == 20) || (f == 50) || (f == 100) || (f == 200) || (f == 500))
-            {
-                axislabel = String((int)f);
-                drawText = true;
-            }
-            else if ((f == 1000) || (f == 2000) || (f == 5000) || (f == 10000) || (f == 20000))
-            {
-                axislabel = String((int)f/1000);
-                axislabel << "k";
-                drawText = true;
-            }
-
-            if (drawText)
-            {
-                g.drawText (axislabel, xpos - 10, dirToY(s.yMin) + OH + 0.0f, 30, 12, Justification::centred, true);
-            }
+            g.setColour (Colours::white);
+            g.strokePath (*patternPath, PathStrokeType (2.0f));
         }
-
-        g.setColour (Colours::whitesmoke.withMultipliedAlpha(0.1f));
-        g.fillRect (static_cast<float>(hzToX(s.fMin)), dirToY(0),
-                    static_cast<float>(hzToX(s.fMax) - hzToX(s.fMin)),
-                    dirToY(-0.5) - dirToY(0));
-        
-        // set path colours and stroke
-        g.setColour (Colours::white);
-        g.strokePath (dirGridPath, PathStrokeType (0.5f));
-        
-        g.setColour (Colours::white.withMultipliedAlpha(0.5f));
-        g.strokePath (smallDirGridPath, PathStrokeType (0.5f));
-
-        g.setColour (Colours::white);
-        g.strokePath (hzGridPathBold, PathStrokeType (0.5f));
-
-        g.setColour (Colours::white.withMultipliedAlpha(0.5f));
-        g.strokePath (hzGridPath, PathStrokeType (0.5f));
         
         for (PathComponent& p : bandLimitPaths)
         {
@@ -304,6 +229,9 @@ public:
         int interpPointMargin = 15;
         int patternRectHeight = 14;
         
+        for (int i = 0; i < 5; ++i)
+            paintedBandAreas[i] = i < nrActiveBands ? getBandArea (i) : Rectangle<int>();
+        
         // paint dirPaths and bandLimitPaths
         for (int i = 0; i < nrActiveBands; ++i)
         {
@@ -312,17 +240,14 @@ public:
             float rightBound = (handle.upperFrequencySlider == nullptr || nrActiveBands == i + 1) ?
                                 hzToX(s.fMax) : hzToX (processor.hzFromZeroToOne(i, handle.upperFrequencySlider->getValue()));
             
-            float circY = handle.dirSlider == nullptr ? dirToY(0.0f) : dirToY(handle.dirSlider->getValue());
+            float circY = dirToY (getDirFactor (i));
             
             // paint band limits
             if (i != nrActiveBands - 1)
             {
+                setBandLimitPath (i, rightBound);
                 Path& blPath = bandLimitPaths[i].getPath();
                 
-                blPath.startNewSubPath (rightBound, dirToY(s.yMax)-OH);
-                
-                blPath.lineTo (rightBound, dirToY(s.yMin)+OH);
-                
 //blPath.addRectangle(rightBound - 20.0, dirToY(s.yMin)+OH - 20, 40, 40);
                 
                 g.setColour (Colours::steelblue.withMultipliedAlpha(activeBandLimitPath == i ? 1.0f : 0.8f));
@@ -346,8 +271,6 @@ public:
                 }
 #endif
 
-                bandLimitPaths[i].setBounds();
-
             }
             
             // dirPath
@@ -415,7 +338,7 @@ public:
             float leftBound = handle.lowerFrequencySlider == nullptr ? hzToX (s.fMin) : hzToX (processor.hzFromZeroToOne(i-1, handle.lowerFrequencySlider->getValue()));
             float rightBound = (handle.upperFrequencySlider == nullptr || nrActiveBands == i + 1) ? hzToX (s.fMax) : hzToX (processor.hzFromZeroToOne(i, handle.upperFrequencySlider->getValue()));
             float circX = (rightBound + leftBound) / 2;
-            float circY = handle.dirSlider == nullptr ? dirToY (0.0f) : dirToY (handle.dirSlider->getValue());
+            float circY = dirToY (getDirFactor (i));
             handle.handlePos.setXY(circX,circY);
                         
             // paint band handles
@@ -461,8 +384,6 @@ public:
             
             handle.polarPatternVisualizer->setActive(true);
 #endif
-            handle.polarPatternVisualizer->getParentComponent()->resized();
-
 
 //#ifdef AA_DO_DEBUG_PATH
 //            { // !J! for debug purposes only
@@ -734,6 +655,149 @@ public:
         }
     }
 
+    // everything static: pattern icons, frequency labels and the grid, in physical pixels
+    void renderBackground (float scaleFactor)
+    {
+        backgroundScaleFactor = scaleFactor;
+        backgroundImage = Image (Image::ARGB, jmax (1, roundToInt (getWidth() * scaleFactor)),
+                                 jmax (1, roundToInt (getHeight() * scaleFactor)), true);
+        Graphics g (backgroundImage);
+        g.addTransform (AffineTransform::scale (scaleFactor));
+        
+        // directivity labels
+        float strokeSizeThin = 0.5f;
+        g.setColour (Colours::white);
+        g.strokePath (eightPath, PathStrokeType (strokeSizeThin));
+        g.fillPath (eightPath);
+        
+        g.strokePath (hCardPath, PathStrokeType (strokeSizeThin));
+        g.fillPath (hCardPath);
+        
+        g.strokePath (sCardPath, PathStrokeType (strokeSizeThin));
+        g.fillPath (sCardPath);
+        
+        g.strokePath (cardPath, PathStrokeType (strokeSizeThin));
+        g.fillPath (cardPath);
+        
+        g.strokePath (bCardPath, PathStrokeType (strokeSizeThin));
+        g.fillPath (bCardPath);
+        
+        g.strokePath (omniPath, PathStrokeType (strokeSizeThin));
+        g.fillPath (omniPath);
+        
+        g.strokePath (rbCardPath, PathStrokeType (strokeSizeThin));
+        g.fillPath (rbCardPath);
+        
+        g.strokePath (rCardPath, PathStrokeType (strokeSizeThin));
+        g.fillPath (rCardPath);
+        
+        // frequency labels
+        g.setFont (getLookAndFeel().getTypefaceForFont (Font(12.0f, 2)));
+        g.setFont (16.0f);
+        for (float f=s.fMin; f <= s.fMax; f += powf(10, floorf(log10(f))))
+        {
+            int xpos = hzToX(f);
+
+            String axislabel;
+            bool drawText = false;
+
+            if ((f == 20) || (f == 50) || (f == 100) || (f == 200) || (f == 500))
+            {
+                axislabel = String((int)f);
+                drawText = true;
+            }
+            else if ((f == 1000) || (f == 2000) || (f == 5000) || (f == 10000) || (f == 20000))
+            {
+                axislabel = String((int)f/1000);
+                axislabel << "k";
+                drawText = true;
+            }
+
+            if (drawText)
+            {
+                g.drawText (axislabel, xpos - 10, dirToY(s.yMin) + OH + 0.0f, 30, 12, Justification::centred, true);
+            }
+        }
+
+        g.setColour (Colours::whitesmoke.withMultipliedAlpha(0.1f));
+        g.fillRect (static_cast<float>(hzToX(s.fMin)), dirToY(0),
+                    static_cast<float>(hzToX(s.fMax) - hzToX(s.fMin)),
+                    dirToY(-0.5) - dirToY(0));
+        
+        // set path colours and stroke
+        g.setColour (Colours::white);
+        g.strokePath (dirGridPath, PathStrokeType (0.5f));
+        
+        g.setColour (Colours::white.withMultipliedAlpha(0.5f));
+        g.strokePath (smallDirGridPath, PathStrokeType (0.5f));
+
+        g.setColour (Colours::white);
+        g.strokePath (hzGridPathBold, PathStrokeType (0.5f));
+
+        g.setColour (Colours::white.withMultipliedAlpha(0.5f));
+        g.strokePath (hzGridPath, PathStrokeType (0.5f));
+    }
+    
+    // Repaints only the given bands (bit i = band i), where they are now and where they were painted last.
+    // The band limits are checked here as well: the editor aligns the band controls with them.
+    void repaintBands (int bandMask)
+    {
+        if (getNumActiveBands() != nrActiveBands)
+        {
+            repaint();
+        }
+        else
+        {
+            Rectangle<int> dirtyArea;
+            for (int i = 0; i < nrActiveBands; ++i)
+                if ((bandMask & (1 << i)) != 0)
+                    dirtyArea = dirtyArea.getUnion (paintedBandAreas[i]).getUnion (getBandArea (i));
+            
+            if (! dirtyArea.isEmpty())
+                repaint (dirtyArea);
+        }
+        
+        updateBandLimits();
+    }
+    
+    // Moves the band limit components to the crossover sliders right away (paint() may come later) and
+    // calls onBandLimitsMoved if the limits or the number of bands changed, or always if forced.
+    void updateBandLimits (bool forceNotification = false)
+    {
+        const int numActiveBands = getNumActiveBands();
+        bool bandLimitsMoved = forceNotification || numActiveBands != layoutNrActiveBands;
+        for (int i = 0; i < 4; ++i)
+        {
+            const int x = getBandLimitX (i);
+            setBandLimitPath (i, static_cast<float> (x));
+            if (i < numActiveBands - 1)
+            {
+                bandLimitsMoved = bandLimitsMoved || x != layoutBandLimits[i];
+                layoutBandLimits[i] = x;
+            }
+        }
+        layoutNrActiveBands = numActiveBands;
+        
+        if (bandLimitsMoved && onBandLimitsMoved != nullptr)
+            onBandLimitsMoved();
+    }
+    
+    // called by updateBandLimits(), the editor aligns the band controls with the band limit components
+    std::function<void()> onBandLimitsMoved;
+    
+    Path* getPatternPath (float dirFact)
+    {
+        if (dirFact == omniFact)   return &omniPath;
+        if (dirFact == cardFact)   return &cardPath;
+        if (dirFact == rCardFact)  return &rCardPath;
+        if (dirFact == eightFact)  return &eightPath;
+        if (dirFact == bCardFact)  return &bCardPath;
+        if (dirFact == rbCardFact) return &rbCardPath;
+        if (dirFact == sCardFact)  return &sCardPath;
+        if (dirFact == hCardFact)  return &hCardPath;
+        return nullptr;
+    }
+    
     void resized() override
     {
         int xMin = hzToX(s.fMin);
@@ -793,8 +857,29 @@ public:
             }
         }
         
+        // pattern icons
+        const float height = static_cast<float>(getHeight());
+        const int dirImgSize = 20;
+        const int smallImgSize = 15;
+        eightPath.applyTransform (eightPath.getTransformToScaleToFit (5.0f, mT - dirImgSize / 2, dirImgSize, dirImgSize, true, Justification::left));
+        hCardPath.applyTransform (hCardPath.getTransformToScaleToFit (mL / 2 - 15.0f, height / 6 + 3.0f, smallImgSize, smallImgSize, true, Justification::right));
+        sCardPath.applyTransform (sCardPath.getTransformToScaleToFit (mL / 2 - 14.0f, height / 4, smallImgSize, smallImgSize, true, Justification::right));
+        cardPath.applyTransform (cardPath.getTransformToScaleToFit (1.0f, height / 3 - dirImgSize / 2 + 4.0f, dirImgSize, dirImgSize, true, Justification::right));
+        bCardPath.applyTransform (bCardPath.getTransformToScaleToFit (mL / 2 - 13.0f, height / 2 - 27.0f, smallImgSize, smallImgSize, true, Justification::right));
+        omniPath.applyTransform (omniPath.getTransformToScaleToFit (1.0f, height * 2 / 3 - dirImgSize / 2 - 6.0f, dirImgSize, dirImgSize, true, Justification::right));
+        rbCardPath.applyTransform (rbCardPath.getTransformToScaleToFit (mL / 2 - 13.0f, height - mB - smallImgSize / 2 - 22.0f, smallImgSize, smallImgSize, true, Justification::right));
+        rCardPath.applyTransform (rCardPath.getTransformToScaleToFit (1.0f, height - mB - dirImgSize / 2, dirImgSize, dirImgSize, true, Justification::right));
+        
+        backgroundImage = Image();
+        
         initValueBox();
     }
+    
+    void lookAndFeelChanged() override
+    {
+        backgroundImage = Image(); // label font
+        repaint();
+    }
 
     void addSliders(Colour newColour, Slider* dirSlider = nullptr, Slider* lowerFrequencySlider = nullptr, Slider* upperFrequencySlider = nullptr, MuteSoloButton* soloButton = nullptr, MuteSoloButton* muteButton = nullptr, Slider* gainSlider = nullptr, PolarPatternVisualizer* directivityVis = nullptr
                     )
@@ -821,6 +906,8 @@ public:
         soloActive = set;
     }
     
+    bool isSoloActive() const { return soloActive; }
+    
     float calcAlphaOfDirPath(BandElements& elem)
     {
         float maxGain = std::max(elem.gainSlider->getMaximum(), std::abs(elem.gainSlider->getMinimum()));
@@ -945,6 +1032,46 @@ public:
     }
 
 private:
+    int getNumActiveBands()
+    {
+        return processor.zeroDelayModeActive() ? 1 : processor.getNBands();
+    }
+    
+    // the adaptive mode changes the patterns without moving the sliders
+    float getDirFactor (int idx)
+    {
+        if (processor.adaptiveModeActive())
+            return processor.getAdaptiveAlpha (idx);
+        
+        Slider* slider = elements[idx].dirSlider;
+        return slider == nullptr ? 0.0f : static_cast<float> (slider->getValue());
+    }
+    
+    int getBandLimitX (int idx)
+    {
+        Slider* slider = elements[idx].upperFrequencySlider;
+        return slider == nullptr ? hzToX (s.fMax) : hzToX (processor.hzFromZeroToOne (idx, slider->getValue()));
+    }
+    
+    // vertical line at x, the component around it grabs the mouse
+    void setBandLimitPath (int idx, float x)
+    {
+        Path& blPath = bandLimitPaths[idx].getPath();
+        blPath.clear();
+        blPath.startNewSubPath (x, dirToY(s.yMax)-OH);
+        blPath.lineTo (x, dirToY(s.yMin)+OH);
+        bandLimitPaths[idx].setBounds();
+    }
+    
+    // everything a band paints: its curve with the transitions to its neighbours, its handle and band limits
+    Rectangle<int> getBandArea (int idx)
+    {
+        const int margin = 20 + static_cast<int> (POLAR_DESIGNER_KNOBS_SIZE); // transition (bandMargin in paint()) and handle
+        const int left = idx == 0 ? hzToX (s.fMin) : getBandLimitX (idx - 1);
+        const int right = idx >= nrActiveBands - 1 ? hzToX (s.fMax) : getBandLimitX (idx);
+        return Rectangle<int> (left - margin, 0, right - left + 2 * margin, getHeight());
+    }
+    
     PolarDesignerAudioProcessor& processor;
     
     bool active = true;
@@ -963,6 +1090,11 @@ private:
     Path hzGridPathBold;
     Path dirPaths[5];
     Path smallDirGridPath;
+    Image backgroundImage; // grid, labels and icons, see renderBackground()
+    float backgroundScaleFactor = 1.0f;
+    Rectangle<int> paintedBandAreas[5];
+    int layoutBandLimits[4] = {};
+    int layoutNrActiveBands = 0;
     
     std::unique_ptr<Label> tooltipValueBox[4];
 
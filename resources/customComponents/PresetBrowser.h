@@ -0,0 +1,168 @@
+/*
+ ==============================================================================
+ PresetBrowser.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "../../JuceLibraryCode/JuceHeader.h"
+#include "../PresetLibrary.h"
+
+// Searchable list of the presets in the preset folder, shown in a CallOutBox by the editor. Every row shows the
+// polar patterns of the preset's bands, its name and its settings; double click or return loads a preset.
+class PresetBrowser : public Component, private ListBoxModel, private ChangeListener, private TextEditor::Listener
+{
+public:
+    using LoadCallback = std::function<void (const File&)>;
+
+    PresetBrowser (PresetLibrary& presetLibrary, const Array<Colour>& colours, LoadCallback loadCallback)
+        : library (presetLibrary), bandColours (colours), onLoad (std::move (loadCallback))
+    {
+        addAndMakeVisible (searchField);
+        searchField.setTextToShowWhenEmpty ("search, e.g. vocal 3 bands cardioid", Colours::white.withMultipliedAlpha (0.4f));
+        searchField.addListener (this);
+
+        addAndMakeVisible (list);
+        list.setModel (this);
+        list.setRowHeight (ROW_HEIGHT);
+        list.setColour (ListBox::backgroundColourId, Colours::transparentBlack);
+
+        addAndMakeVisible (status);
+        status.setFont (Font (12.0f));
+        status.setColour (Label::textColourId, Colours::white.withMultipliedAlpha (0.6f));
+
+        library.addChangeListener (this);
+        updateResults();
+        setSize (360, 420);
+    }
+
+    ~PresetBrowser() override
+    {
+        library.removeChangeListener (this);
+    }
+
+    void resized() override
+    {
+        auto area = getLocalBounds().reduced (6);
+        searchField.setBounds (area.removeFromTop (24));
+        area.removeFromTop (4);
+        status.setBounds (area.removeFromBottom (20));
+        list.setBounds (area);
+    }
+
+private:
+    static constexpr int ROW_HEIGHT = 44;
+
+    int getNumRows() override { return results.size(); }
+
+    void paintListBoxItem (int row, Graphics& g, int width, int height, bool rowIsSelected) override
+    {
+        if (! isPositiveAndBelow (row, results.size()))
+            return;
+
+        if (rowIsSelected)
+            g.fillAll (Colours::white.withMultipliedAlpha (0.1f));
+
+        const PresetLibrary::Entry& entry = results.getReference (row);
+        const Rectangle<float> thumbnailArea (2.0f, 2.0f, height - 4.0f, height - 4.0f);
+        const Image thumbnail (getThumbnail (entry, 2 * (height - 4))); // sharp on high resolution displays
+        if (thumbnail.isValid())
+            g.drawImage (thumbnail, thumbnailArea);
+
+        const int textX = height + 4;
+        g.setColour (Colours::white);
+        g.setFont (Font (14.0f));
+        g.drawText (entry.getName(), textX, 2, width - textX - 4, height / 2 - 2, Justification::bottomLeft, true);
+
+        g.setColour (Colours::white.withMultipliedAlpha (0.6f));
+        g.setFont (Font (12.0f));
+        const String details (String (entry.numBands) + (entry.numBands == 1 ? " band: " : " bands: ")
+                              + entry.getPatternSummary() + ", " + entry.getEqName());
+        g.drawText (details, textX, height / 2, width - textX - 4, height / 2 - 2, Justification::topLeft, true);
+    }
+
+    void listBoxItemDoubleClicked (int row, const MouseEvent&) override { load (row); }
+    void returnKeyPressed (int row) override { load (row); }
+
+    void textEditorTextChanged (TextEditor&) override { updateResults(); }
+    void textEditorReturnKeyPressed (TextEditor&) override { load (jmax (0, list.getSelectedRow())); }
+
+    void changeListenerCallback (ChangeBroadcaster*) override { updateResults(); }
+
+    void load (int row)
+    {
+        if (! isPositiveAndBelow (row, results.size()) || onLoad == nullptr)
+            return;
+
+        if (auto* callOutBox = findParentComponentOfClass<CallOutBox>())
+            callOutBox->dismiss(); // asynchronous, the browser is still there for the callback
+        onLoad (results.getReference (row).file);
+    }
+
+    void updateResults()
+    {
+        results = library.search (searchField.getText());
+        list.updateContent();
+        list.repaint();
+
+        const File folder (library.getFolder());
+        if (! folder.isDirectory())
+            status.setText ("Load or save a preset to choose the preset folder.", dontSendNotification);
+        else if (library.isScanning() && library.getEntries().isEmpty())
+            status.setText ("Scanning " + folder.getFileName() + " ...", dontSendNotification);
+        else
+            status.setText (String (results.size()) + " of " + String (library.getEntries().size()) + " presets in "
+                            + folder.getFileName(), dontSendNotification);
+    }
+
+    // requested the first time a row is painted, the row is repainted when it arrives
+    Image getThumbnail (const PresetLibrary::Entry& entry, int size)
+    {
+        const String key (entry.file.getFullPathName() + String (entry.modificationTime));
+        auto found = thumbnails.find (key);
+        if (found != thumbnails.end())
+            return found->second;
+
+        thumbnails[key] = Image(); // requested
+        SafePointer<PresetBrowser> safeThis (this);
+        library.requestThumbnail (entry, size, bandColours, [safeThis, key] (const Image& thumbnail)
+        {
+            if (safeThis == nullptr)
+                return;
+
+            safeThis->thumbnails[key] = thumbnail;
+            safeThis->list.repaint();
+        });
+        return thumbnails[key];
+    }
+
+    PresetLibrary& library;
+    const Array<Colour> bandColours;
+    LoadCallback onLoad;
+
+    TextEditor searchField;
+    ListBox list;
+    Label status;
+
+    Array<PresetLibrary::Entry> results;
+    std::map<String, Image> thumbnails;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PresetBrowser)
+};